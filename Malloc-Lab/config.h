@@ -32,6 +32,16 @@
   "binary-bal.rep",\
   "binary2-bal.rep"
 
+/*
+ * Realloc-heavy traces that mdriver -R runs instead of the default
+ * ones: a buffer growing past blocks that pin it, a medium sized buffer
+ * growing a few bytes at a time, and small strings appended to.
+ */
+#define REALLOC_TRACEFILES \
+  "realloc-bal.rep",\
+  "realloc2-bal.rep",\
+  "realloc3-bal.rep"
+
 /*
  * This constant gives the estimated performance of the libc malloc
  * package using our traces on some reference system, typically the
@@ -56,9 +66,21 @@
 #define ALIGNMENT 8  
 
 /* 
- * Maximum heap size in bytes 
+ * Maximum heap size in bytes. memlib only reserves this much address
+ * space; pages are committed as the heap first touches them. If the
+ * reservation fails, as it can under ulimit -v, it is halved down to
+ * MIN_HEAP. Larger heaps ask for their size with mem_init_reserve or
+ * mem_area_create.
+ */
+#define MAX_HEAP (4ULL << 30)   /* 4 GB */
+#define MIN_HEAP (64ULL << 20)  /* 64 MB */
+
+/*
+ * Size of a shared memory heap created without a size. The object is
+ * backed by /dev/shm, which is usually only half of RAM, so it stays
+ * far below MAX_HEAP.
  */
-#define MAX_HEAP (2000*(1<<20))  /* 2000 MB */
+#define SHARED_HEAP (64ULL << 20)  /* 64 MB */
 
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
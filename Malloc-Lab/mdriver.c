@@ -54,7 +54,8 @@ typedef struct {
            FREE,
            REALLOC } type; /* type of request */
     int index;             /* index for free() to use later */
-    int size;              /* byte size of alloc/realloc request */
+    size_t size;           /* byte size of alloc/realloc request */
+    int hint;              /* mm_malloc_hint hints of an alloc (-H) */
 } traceop_t;
 
 /* Holds the information for one trace file*/
@@ -76,6 +77,7 @@ typedef struct {
 typedef struct {
     trace_t *trace;
     range_t *ranges;
+    int *epoch_ids; /* ids allocated in the current epoch (-e) */
 } speed_t;
 
 /* Summarizes the important stats for some malloc function on some trace */
@@ -86,11 +88,13 @@ typedef struct {
     int valid;   /* was the trace processed correctly by the allocator? */
     double secs; /* number of secs needed to run the trace */
 
-    int ideal_max_heap;
-    int max_heap;
+    size_t ideal_max_heap;
+    size_t max_heap;
 
     /* defined only for the student malloc package */
     double util; /* space utilization for this trace (always 0 for libc) */
+    double base_util; /* space utilization under the -B configuration */
+    size_t extensions; /* times the heap grew in the utilization run */
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t;
@@ -100,6 +104,15 @@ typedef struct {
  *******************/
 int verbose = 0;       /* global flag for verbose output */
 static int errors = 0; /* number of errs found when running student malloc */
+static unsigned maint_interval = 0; /* if nonzero, run mm's maintenance thread every maint_interval ms (-m) */
+static int epoch_ops = 0; /* if nonzero, also replay traces in epochs of epoch_ops requests (-e) */
+static char *mm_conf = NULL; /* mm tunables for every trace (-C) */
+static char **trace_confs = NULL; /* <trace>=<tunables> overrides (-c) */
+static int num_trace_confs = 0;
+static char *base_conf = NULL; /* mm tunables to compare utilization against (-B) */
+static int hint_horizon = 0; /* if nonzero, pass mm_malloc_hint the lifetime of each block, short if freed within hint_horizon requests (-H) */
+static int synthetic_sites = 0; /* if set, pass mm_malloc_site one allocation site per request size (-S) */
+static char *profile_path = NULL; /* if set, pre-warm mm with each trace's profile, saved here (-P) */
 char msg[MAXLINE];     /* for whenever we need to compose an error message */
 
 
@@ -110,12 +123,16 @@ static char tracedir[MAXLINE] = TRACEDIR;
 static char *default_tracefiles[] = {
     DEFAULT_TRACEFILES, NULL};
 
+/* The realloc-heavy tracefiles run by -R */
+static char *realloc_tracefiles[] = {
+    REALLOC_TRACEFILES, NULL};
+
 /*********************
  * Function prototypes
  *********************/
 
 /* these functions manipulate range lists */
-static int add_range(range_t **ranges, char *lo, int size,
+static int add_range(range_t **ranges, char *lo, size_t size,
                      int tracenum, int opnum);
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
@@ -123,6 +140,9 @@ static void clear_ranges(range_t **ranges);
 /* These functions read, allocate, and free storage for traces */
 static trace_t *read_trace(char *tracedir, char *filename);
 static void free_trace(trace_t *trace);
+static void derive_hints(trace_t *trace);
+static void *mm_alloc(traceop_t *op);
+static void make_profile(trace_t *trace, char *path);
 
 /* Routines for evaluating the correctness and speed of libc malloc */
 static int eval_libc_valid(trace_t *trace, int tracenum);
@@ -131,12 +151,18 @@ static void eval_libc_speed(void *ptr);
 /* Routines for evaluating correctnes, space utilization, and speed
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges, int *ideal_m, int *m);
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges, size_t *ideal_m, size_t *m);
 static void eval_mm_speed(void *ptr);
+static int reset_mm(void);
+static int eval_mm_epoch_valid(trace_t *trace, int tracenum, range_t **ranges, int *ids);
+static void eval_mm_epoch_free(void *ptr);
+static void eval_mm_epoch_region(void *ptr);
+static int replay_region(trace_t *trace, int tracenum, range_t **ranges, int *ids);
 
 /* Various helper routines */
-static void printresults(int n, stats_t *stats);
+static void printresults(int n, stats_t *stats, int show_extends, int show_base);
 static void usage(void);
+static void configure_mm(char *tracefile);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
 static void app_error(char *msg);
@@ -160,6 +186,7 @@ int main(int argc, char **argv) {
     int team_check = 1; /* If set, check team structure (reset by -a) */
     int run_libc = 0;   /* If set, run libc malloc (set by -l) */
     int autograder = 0; /* If set, emit summary info for autograder (-g) */
+    int realloc_set = 0; /* If set, run the realloc-heavy traces (-R) */
 
     /* temporaries used to compute the performance index */
     double util, scaled_util, throughput, avg_mm_util, avg_mm_throughput, perfindex; 
@@ -169,7 +196,7 @@ int main(int argc, char **argv) {
     /*
      * Read and interpret the command line arguments
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt(argc, argv, "f:t:m:e:c:C:B:H:SP:RhvVgal")) != EOF) {
         switch (c) {
         case 'g': /* Generate summary info for the autograder */
             autograder = 1;
@@ -195,6 +222,53 @@ int main(int argc, char **argv) {
         case 'l': /* Run libc malloc */
             run_libc = 1;
             break;
+        case 'm': /* Run the maintenance thread every <ms> milliseconds */
+            maint_interval = atoi(optarg);
+            break;
+        case 'e': /* Replay the traces in epochs of <n> requests */
+            if ((epoch_ops = atoi(optarg)) <= 0) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'C': /* Tune mm for every trace */
+            if (mm_configure(optarg) < 0) {
+                fprintf(stderr, "mdriver: bad mm configuration \"%s\"\n", optarg);
+                exit(1);
+            }
+            mm_conf = optarg;
+            break;
+        case 'c': /* Tune mm for one trace */
+            if (strchr(optarg, '=') == NULL || mm_configure(strchr(optarg, '=') + 1) < 0) {
+                fprintf(stderr, "mdriver: bad per-trace configuration \"%s\"\n", optarg);
+                exit(1);
+            }
+            if ((trace_confs = realloc(trace_confs, (num_trace_confs + 1) * sizeof(char *))) == NULL)
+                unix_error("ERROR: realloc failed in main");
+            trace_confs[num_trace_confs++] = optarg;
+            break;
+        case 'B': /* Compare utilization against other tunables */
+            if (mm_configure(optarg) < 0) {
+                fprintf(stderr, "mdriver: bad baseline configuration \"%s\"\n", optarg);
+                exit(1);
+            }
+            base_conf = optarg;
+            break;
+        case 'H': /* Hint lifetimes to mm from the trace's future */
+            if ((hint_horizon = atoi(optarg)) <= 0) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'S': /* Allocate from a synthetic site per size */
+            synthetic_sites = 1;
+            break;
+        case 'P': /* Pre-warm mm with a profile of each trace */
+            profile_path = optarg;
+            break;
+        case 'R': /* Use the realloc-heavy traces */
+            realloc_set = 1;
+            break;
         case 'v': /* Print per-trace performance breakdown */
             verbose = 1;
             break;
@@ -251,9 +325,12 @@ int main(int argc, char **argv) {
 
     /*
      * If no -f command line arg, then use the entire set of tracefiles
-     * defined in default_traces[]
+     * defined in default_traces[], or in realloc_tracefiles[] with -R
      */
-    if (tracefiles == NULL) {
+    if (tracefiles == NULL && realloc_set) {
+        tracefiles = realloc_tracefiles;
+        num_tracefiles = sizeof(realloc_tracefiles) / sizeof(char *) - 1;
+    } else if (tracefiles == NULL) {
         tracefiles = default_tracefiles;
         num_tracefiles = sizeof(default_tracefiles) / sizeof(char *) - 1;
         //printf("Using default tracefiles in %s\n", tracedir);
@@ -299,7 +376,7 @@ int main(int argc, char **argv) {
         /* Display the libc results in a compact table */
         if (verbose) {
             printf("\nResults for libc malloc:\n");
-            printresults(num_tracefiles, libc_stats);
+            printresults(num_tracefiles, libc_stats, 0, 0);
         }
     }
 
@@ -314,7 +391,8 @@ int main(int argc, char **argv) {
     if (mm_stats == NULL)
         unix_error("mm_stats calloc in main failed");
 
-    int max_heap, ideal_max_heap;
+    size_t max_heap, ideal_max_heap;
+    mm_stats_t growth;
     int trial_counter;
     double prev_secs;
     for (trial_counter = 0; trial_counter < NUM_TRIAL; trial_counter ++) {
@@ -329,6 +407,11 @@ int main(int argc, char **argv) {
                 prev_secs = mm_stats[i].secs;
             }
             trace = read_trace(tracedir, tracefiles[i]);
+            configure_mm(tracefiles[i]);
+            if (hint_horizon)
+                derive_hints(trace);
+            if (profile_path != NULL)
+                make_profile(trace, profile_path);
             trace_weights[i] = trace->weight;
             mm_stats[i].ops = trace->num_ops;
             mm_stats[i].filename = tracefiles[i];
@@ -339,6 +422,24 @@ int main(int argc, char **argv) {
                 if (verbose > 1)
                     printf("efficiency, ");
                 mm_stats[i].util = eval_mm_util(trace, i, &ranges, &ideal_max_heap, &max_heap);
+                mm_get_stats(&growth);
+                mm_stats[i].extensions = growth.extensions;
+                if ((base_conf != NULL || hint_horizon || profile_path != NULL) && trial_counter == 0) {
+                    size_t base_ideal_max_heap, base_max_heap;
+                    int horizon = hint_horizon;
+
+                    /* With -H the baseline is the same run without hints, with -P without the profile */
+                    if (base_conf != NULL)
+                        mm_configure(base_conf);
+                    if (profile_path != NULL)
+                        mm_profile_load(NULL);
+                    hint_horizon = 0;
+                    mm_stats[i].base_util = eval_mm_util(trace, i, &ranges, &base_ideal_max_heap, &base_max_heap);
+                    hint_horizon = horizon;
+                    if (profile_path != NULL)
+                        mm_profile_load(profile_path);
+                    configure_mm(tracefiles[i]);
+                }
 
                 mm_stats[i].max_heap = max_heap;
                 mm_stats[i].ideal_max_heap = ideal_max_heap;
@@ -356,13 +457,49 @@ int main(int argc, char **argv) {
         }
     }
 
+    if (maint_interval)
+        mm_maint_stop();
+
     /* Display the mm results in a compact table */
     if (verbose) {
         fprintf(result_fstream,"\nResults for mm malloc:\n");
-        printresults(num_tracefiles, mm_stats);
+        printresults(num_tracefiles, mm_stats, 1, base_conf != NULL || hint_horizon || profile_path != NULL);
         fprintf(result_fstream,"\n");
     }
 
+    /*
+     * Optionally replay each trace in epochs, dropping whatever an
+     * epoch allocated either one object at a time with mm_free or all
+     * at once by releasing a region
+     */
+    if (epoch_ops) {
+        double free_secs, region_secs;
+
+        printf("Epoch replay (%d requests per epoch):\n", epoch_ops);
+        printf("%35s%8s%10s%10s%8s\n", "trace", "epochs", "mm_free", "region", "speedup");
+        for (i = 0; i < num_tracefiles; i++) {
+            trace = read_trace(tracedir, tracefiles[i]);
+            configure_mm(tracefiles[i]);
+            if ((speed_params.epoch_ids = malloc(trace->num_ops * sizeof(int))) == NULL)
+                unix_error("epoch_ids malloc in main failed");
+            speed_params.trace = trace;
+            if (eval_mm_epoch_valid(trace, i, &ranges, speed_params.epoch_ids)) {
+                free_secs = fsecs(eval_mm_epoch_free, &speed_params);
+                region_secs = fsecs(eval_mm_epoch_region, &speed_params);
+                printf("%35s%8d%10.6f%10.6f%7.2fx\n", tracefiles[i],
+                       (trace->num_ops + epoch_ops - 1) / epoch_ops,
+                       free_secs, region_secs, free_secs / region_secs);
+            } else {
+                printf("%35s%8s%10s%10s%8s\n", tracefiles[i], "-", "-", "-", "-");
+            }
+            free(speed_params.epoch_ids);
+            free_trace(trace);
+        }
+        if (maint_interval)
+            mm_maint_stop();
+        printf("\n");
+    }
+
     /*
      * Accumulate the aggregate statistics for the student's mm package
      */
@@ -420,7 +557,7 @@ int main(int argc, char **argv) {
  *     size bytes at addr lo. After checking the block for correctness,
  *     we create a range struct for this block and add it to the range list.
  */
-static int add_range(range_t **ranges, char *lo, int size,
+static int add_range(range_t **ranges, char *lo, size_t size,
                      int tracenum, int opnum) {
     char *hi = lo + size - 1;
     range_t *p;
@@ -436,9 +573,10 @@ static int add_range(range_t **ranges, char *lo, int size,
         return 0;
     }
 
-    /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
-        (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+    /* The payload must lie within the extent of the heap or of one mapping */
+    if (((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
+         (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) &&
+        !mem_is_area(lo, hi) && !mem_is_mapped(lo, hi)) {
         sprintf(msg, "Payload (%p:%p) lies outside heap (%p:%p)",
                 lo, hi, mem_heap_lo(), mem_heap_hi());
         malloc_error(tracenum, opnum, msg);
@@ -514,7 +652,8 @@ static trace_t *read_trace(char *tracedir, char *filename) {
     trace_t *trace;
     char type[MAXLINE];
     char path[500];
-    unsigned index, size;
+    unsigned index;
+    size_t size;
     unsigned max_index = 0;
     unsigned op_index;
 
@@ -558,14 +697,14 @@ static trace_t *read_trace(char *tracedir, char *filename) {
     while (fscanf(tracefile, "%s", type) != EOF) {
         switch (type[0]) {
         case 'a':
-            fscanf(tracefile, "%u %u", &index, &size);
+            fscanf(tracefile, "%u %zu", &index, &size);
             trace->ops[op_index].type = ALLOC;
             trace->ops[op_index].index = index;
             trace->ops[op_index].size = size;
             max_index = (index > max_index) ? index : max_index;
             break;
         case 'r':
-            fscanf(tracefile, "%u %u", &index, &size);
+            fscanf(tracefile, "%u %zu", &index, &size);
             trace->ops[op_index].type = REALLOC;
             trace->ops[op_index].index = index;
             trace->ops[op_index].size = size;
@@ -601,6 +740,97 @@ void free_trace(trace_t *trace) {
     free(trace); /* and the trace record itself... */
 }
 
+/*
+ * mm_alloc - Serve an alloc request with mm_malloc_hint under -H, with
+ *     mm_malloc_site under -S, or else with mm_malloc
+ */
+static void *mm_alloc(traceop_t *op) {
+    if (hint_horizon)
+        return mm_malloc_hint(op->size, op->hint);
+    if (synthetic_sites)
+        return mm_malloc_site(op->size, (void *)(uintptr_t)op->size);
+    return mm_malloc(op->size);
+}
+
+/*
+ * make_profile - Replay the trace up to the request after which the most
+ *     payload bytes are live, save mm's live blocks there as a profile in
+ *     path and have mm pre-warm from it from the next mm_init on
+ */
+static void make_profile(trace_t *trace, char *path) {
+    size_t live = 0, peak_live = 0;
+    int peak = -1;
+    int i;
+
+    /* Find the peak from the trace alone, mm's block sizes come later */
+    for (i = 0; i < trace->num_ops; i++) {
+        traceop_t *op = &trace->ops[i];
+
+        if (op->type == FREE) {
+            live -= trace->block_sizes[op->index];
+        } else {
+            if (op->type == REALLOC)
+                live -= trace->block_sizes[op->index];
+            live += op->size;
+            trace->block_sizes[op->index] = op->size;
+        }
+        if (live > peak_live) {
+            peak_live = live;
+            peak = i;
+        }
+    }
+
+    /* A cold heap records what the trace itself needs */
+    mm_profile_load(NULL);
+    if (reset_mm() < 0)
+        app_error("mm_init failed in make_profile");
+    for (i = 0; i <= peak; i++) {
+        traceop_t *op = &trace->ops[i];
+
+        if (op->type == ALLOC)
+            trace->blocks[op->index] = mm_alloc(op);
+        else if (op->type == REALLOC)
+            trace->blocks[op->index] = mm_realloc(trace->blocks[op->index], op->size);
+        else
+            mm_free(trace->blocks[op->index]);
+        if (op->type != FREE && trace->blocks[op->index] == NULL)
+            app_error("mm failed in make_profile");
+    }
+
+    if (mm_profile_save(path) < 0 || mm_profile_load(path) < 0) {
+        sprintf(msg, "cannot save a profile to %s", path);
+        app_error(msg);
+    }
+}
+
+/*
+ * derive_hints - Hint every alloc in the trace as short lived if the
+ *     trace frees it within hint_horizon requests, and as long lived
+ *     if it is freed later or never
+ */
+static void derive_hints(trace_t *trace) {
+    int *freed_at; /* request that frees each id, -1 if none */
+    int i;
+
+    if ((freed_at = malloc(trace->num_ids * sizeof(int))) == NULL)
+        unix_error("malloc failed in derive_hints");
+    for (i = 0; i < trace->num_ids; i++)
+        freed_at[i] = -1;
+
+    /* Walking backwards, every alloc already knows when its id is freed */
+    for (i = trace->num_ops - 1; i >= 0; i--) {
+        traceop_t *op = &trace->ops[i];
+
+        op->hint = 0;
+        if (op->type == FREE)
+            freed_at[op->index] = i;
+        else if (op->type == ALLOC)
+            op->hint = freed_at[op->index] >= 0 && freed_at[op->index] - i <= hint_horizon
+                           ? MM_HINT_SHORT : MM_HINT_LONG;
+    }
+    free(freed_at);
+}
+
 /**********************************************************************
  * The following functions evaluate the correctness, space utilization,
  * and throughput of the libc and mm malloc packages.
@@ -610,20 +840,20 @@ void free_trace(trace_t *trace) {
  * eval_mm_valid - Check the mm malloc package for correctness
  */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) {
-    int i, j;
+    int i;
+    size_t j;
     int index;
-    int size;
-    int oldsize;
+    size_t size;
+    size_t oldsize;
     char *newp;
     char *oldp;
     char *p;
 
-    /* Reset the heap and free any records in the range list */
-    mem_reset_brk();
+    /* Free any records in the range list */
     clear_ranges(ranges);
 
-    /* Call the mm package's init function */
-    if (mm_init() < 0) {
+    /* Reset the heap and call the mm package's init function */
+    if (reset_mm() < 0) {
         malloc_error(tracenum, 0, "mm_init failed.");
         return 0;
     }
@@ -638,7 +868,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) {
         case ALLOC: /* mm_malloc */
 
             /* Call the student's malloc */
-            if ((p = mm_malloc(size)) == NULL) {
+            if ((p = mm_alloc(&trace->ops[i])) == NULL) {
                 malloc_error(tracenum, i, "mm_malloc failed.");
                 return 0;
             }
@@ -688,7 +918,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) {
             if (size < oldsize)
                 oldsize = size;
             for (j = 0; j < oldsize; j++) {
-                if (newp[j] != (index & 0xFF)) {
+                if ((unsigned char)newp[j] != (index & 0xFF)) {
                     malloc_error(tracenum, i, "mm_realloc did not preserve the "
                                               "data from old block");
                     return 0;
@@ -714,6 +944,20 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) {
         }
     }
 
+    /*
+     * Give the free space at the top of the heap back. Whatever is
+     * still allocated must remain inside the (smaller) heap.
+     */
+    mm_trim(0);
+    for (range_t *r = *ranges; r != NULL; r = r->next) {
+        if (!mem_is_area(r->lo, r->hi) && !mem_is_mapped(r->lo, r->hi)) {
+            sprintf(msg, "mm_trim released live payload (%p:%p), heap now ends at %p",
+                    r->lo, r->hi, mem_heap_hi());
+            malloc_error(tracenum, trace->num_ops - 1, msg);
+            return 0;
+        }
+    }
+
     /* As far as we know, this is a valid malloc package */
     return 1;
 }
@@ -724,28 +968,26 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) {
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the
  *   size of the heap in bytes after running the student's malloc
- *   package on the trace. Note that our implementation of mem_sbrk()
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap.
+ *   package on the trace. Since mem_sbrk() allows the brk pointer to
+ *   be decremented, heapsize is the peak footprint that memlib recorded
+ *   (brk plus separately mapped blocks) rather than the final brk.
  *
  */
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges, int *ideal_max_heap, int *max_heap) {
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges, size_t *ideal_max_heap, size_t *max_heap) {
     int i;
     int index;
-    int size, newsize, oldsize;
-    int max_total_size = FREE_HEAP;
-    int total_size = 0;
+    size_t size, newsize, oldsize;
+    size_t max_total_size = FREE_HEAP;
+    size_t total_size = 0;
     char *p;
     char *newp, *oldp;
 
     /* initialize the heap and the mm malloc package */
-    mem_reset_brk();
-    if (mm_init() < 0)
+    if (reset_mm() < 0)
         app_error("mm_init failed in eval_mm_util");
 
     for (i = 0; i < trace->num_ops; i++) {
         void *old_lo = mem_heap_lo();
-        void *old_hi = mem_heap_hi();
 
         switch (trace->ops[i].type) {
 
@@ -753,7 +995,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges, int *
             index = trace->ops[i].index;
             size = trace->ops[i].size;
 
-            if ((p = mm_malloc(size)) == NULL)
+            if ((p = mm_alloc(&trace->ops[i])) == NULL)
                 app_error("mm_malloc failed in eval_mm_util");
 
             /* Remember region and size */
@@ -805,11 +1047,11 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges, int *
         default:
             app_error("Nonexistent request type in eval_mm_util");
         }
-        if (old_lo != mem_heap_lo() || old_hi > mem_heap_hi())
-            app_error("Error, tampering with mem_heap_lo/hi");
+        if (old_lo != mem_heap_lo())
+            app_error("Error, tampering with mem_heap_lo");
     }
 
-    *max_heap = mem_heapsize() > FREE_HEAP ? mem_heapsize() : FREE_HEAP;
+    *max_heap = mem_peak_footprint() > FREE_HEAP ? mem_peak_footprint() : FREE_HEAP;
     *ideal_max_heap = max_total_size;
     return ((double)*ideal_max_heap / (double)*max_heap);
 }
@@ -819,13 +1061,13 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges, int *
  *    to measure the running time of the mm malloc package.
  */
 static void eval_mm_speed(void *ptr) {
-    int i, index, size, newsize;
+    int i, index;
+    size_t newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
 
     /* Reset the heap and initialize the mm package */
-    mem_reset_brk();
-    if (mm_init() < 0)
+    if (reset_mm() < 0)
         app_error("mm_init failed in eval_mm_speed");
 
     /* Interpret each trace request */
@@ -834,8 +1076,7 @@ static void eval_mm_speed(void *ptr) {
 
         case ALLOC: /* mm_malloc */
             index = trace->ops[i].index;
-            size = trace->ops[i].size;
-            if ((p = mm_malloc(size)) == NULL)
+            if ((p = mm_alloc(&trace->ops[i])) == NULL)
                 app_error("mm_malloc error in eval_mm_speed");
             trace->blocks[index] = p;
             break;
@@ -860,6 +1101,186 @@ static void eval_mm_speed(void *ptr) {
         }
 }
 
+/*
+ * reset_mm - Reset the simulated heap and reinitialize the mm package.
+ *    The maintenance thread (-m) must not run while the brk is reset,
+ *    so it is stopped around the reset and started again afterwards.
+ */
+static int reset_mm(void) {
+    if (maint_interval)
+        mm_maint_stop();
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+        return -1;
+
+    if (maint_interval && mm_maint_start(maint_interval) < 0)
+        return -1;
+    return 0;
+}
+
+/*
+ * eval_mm_epoch_valid - Check the region replay of a trace: every
+ *    object must be aligned, inside the heap, and must not overlap
+ *    another object of the same epoch
+ */
+static int eval_mm_epoch_valid(trace_t *trace, int tracenum, range_t **ranges, int *ids) {
+    int ok;
+
+    clear_ranges(ranges);
+    if (reset_mm() < 0) {
+        malloc_error(tracenum, 0, "mm_init failed.");
+        return 0;
+    }
+    ok = replay_region(trace, tracenum, ranges, ids);
+    clear_ranges(ranges);
+    return ok;
+}
+
+/*
+ * eval_mm_epoch_free - Replay a trace in epochs of epoch_ops requests.
+ *    Frees within an epoch are honored, and at the end of each epoch
+ *    the objects it left allocated are freed one by one with mm_free.
+ *    Reallocs of an object from an earlier epoch allocate afresh.
+ */
+static void eval_mm_epoch_free(void *ptr) {
+    int i, j, index;
+    int num_ids = 0;
+    size_t size;
+    char *p;
+    trace_t *trace = ((speed_t *)ptr)->trace;
+    int *ids = ((speed_t *)ptr)->epoch_ids;
+
+    if (reset_mm() < 0)
+        app_error("mm_init failed in eval_mm_epoch_free");
+    memset(trace->blocks, 0, trace->num_ids * sizeof(char *));
+
+    for (i = 0; i < trace->num_ops; i++) {
+        index = trace->ops[i].index;
+        size = trace->ops[i].size;
+
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_malloc */
+            if ((p = mm_malloc(size)) == NULL)
+                app_error("mm_malloc error in eval_mm_epoch_free");
+            trace->blocks[index] = p;
+            ids[num_ids++] = index;
+            break;
+
+        case REALLOC: /* mm_realloc */
+            if (trace->blocks[index] == NULL) {
+                p = mm_malloc(size);
+                ids[num_ids++] = index;
+            } else {
+                p = mm_realloc(trace->blocks[index], size);
+            }
+            if (p == NULL)
+                app_error("mm_realloc error in eval_mm_epoch_free");
+            trace->blocks[index] = p;
+            break;
+
+        case FREE: /* mm_free */
+            if (trace->blocks[index] != NULL) {
+                mm_free(trace->blocks[index]);
+                trace->blocks[index] = NULL;
+            }
+            break;
+
+        default:
+            app_error("Nonexistent request type in eval_mm_epoch_free");
+        }
+
+        /* End of the epoch: free every survivor */
+        if ((i + 1) % epoch_ops == 0 || i == trace->num_ops - 1) {
+            for (j = 0; j < num_ids; j++) {
+                if (trace->blocks[ids[j]] != NULL) {
+                    mm_free(trace->blocks[ids[j]]);
+                    trace->blocks[ids[j]] = NULL;
+                }
+            }
+            num_ids = 0;
+        }
+    }
+}
+
+/*
+ * eval_mm_epoch_region - The region counterpart of eval_mm_epoch_free
+ */
+static void eval_mm_epoch_region(void *ptr) {
+    if (reset_mm() < 0)
+        app_error("mm_init failed in eval_mm_epoch_region");
+    replay_region(((speed_t *)ptr)->trace, 0, NULL, ((speed_t *)ptr)->epoch_ids);
+}
+
+/*
+ * replay_region - Replay a trace in epochs of epoch_ops requests out of
+ *    one region. Frees are no-ops, reallocs copy into a new object, and
+ *    each epoch ends by releasing the region back to a mark. If ranges
+ *    is not NULL every object is checked with add_range.
+ */
+static int replay_region(trace_t *trace, int tracenum, range_t **ranges, int *ids) {
+    int i, j, index;
+    int num_ids = 0;
+    size_t size, oldsize;
+    char *p;
+    mm_region_t *region;
+    mm_region_mark_t mark;
+
+    if ((region = mm_region_create(NULL)) == NULL)
+        app_error("mm_region_create failed in replay_region");
+    mark = mm_region_mark(region);
+    memset(trace->blocks, 0, trace->num_ids * sizeof(char *));
+
+    for (i = 0; i < trace->num_ops; i++) {
+        index = trace->ops[i].index;
+        size = trace->ops[i].size;
+
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_region_alloc */
+        case REALLOC:
+            if ((p = mm_region_alloc(region, size)) == NULL)
+                app_error("mm_region_alloc failed in replay_region");
+            if (ranges != NULL && add_range(ranges, p, size, tracenum, i) == 0)
+                return 0;
+            if (trace->blocks[index] == NULL) {
+                ids[num_ids++] = index;
+            } else if (trace->ops[i].type == REALLOC) {
+                oldsize = trace->block_sizes[index];
+                memcpy(p, trace->blocks[index], size < oldsize ? size : oldsize);
+                if (ranges != NULL)
+                    remove_range(ranges, trace->blocks[index]);
+            }
+            trace->blocks[index] = p;
+            trace->block_sizes[index] = size;
+            break;
+
+        case FREE: /* nothing to do until the end of the epoch */
+            if (ranges != NULL && trace->blocks[index] != NULL)
+                remove_range(ranges, trace->blocks[index]);
+            trace->blocks[index] = NULL;
+            break;
+
+        default:
+            app_error("Nonexistent request type in replay_region");
+        }
+
+        /* End of the epoch: drop everything at once */
+        if ((i + 1) % epoch_ops == 0 || i == trace->num_ops - 1) {
+            mm_region_release(region, mark);
+            for (j = 0; j < num_ids; j++)
+                trace->blocks[ids[j]] = NULL;
+            num_ids = 0;
+            if (ranges != NULL)
+                clear_ranges(ranges);
+        }
+    }
+
+    mm_region_destroy(region);
+    return 1;
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -867,7 +1288,8 @@ static void eval_mm_speed(void *ptr) {
  *
  */
 static int eval_libc_valid(trace_t *trace, int tracenum) {
-    int i, newsize;
+    int i;
+    size_t newsize;
     char *p, *newp, *oldp;
 
     for (i = 0; i < trace->num_ops; i++) {
@@ -910,7 +1332,8 @@ static int eval_libc_valid(trace_t *trace, int tracenum) {
  */
 static void eval_libc_speed(void *ptr) {
     int i;
-    int index, size, newsize;
+    int index;
+    size_t size, newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
 
@@ -948,20 +1371,25 @@ static void eval_libc_speed(void *ptr) {
  ************************************/
 
 /*
- * printresults - prints a performance summary for some malloc package
+ * printresults - prints a performance summary for some malloc package,
+ *     with the heap extensions of every trace if show_extends and the change
+ *     in utilization from the -B configuration if show_base
  */
-static void printresults(int n, stats_t *stats) {
+static void printresults(int n, stats_t *stats, int show_extends, int show_base) {
     int i;
+    size_t extensions = 0;
     double secs = 0;
     double ops = 0;
     double util = 0;
+    double base_util = 0;
 
     /* Print the individual results for each trace */
-    printf("%35s%7s %9s%8s%5s %8s%10s%6s\n",
-           "trace", " valid", "idealheap", "maxheap", "util", "ops", "secs", "Kops");
+    printf("%35s%7s %9s%8s%5s %8s%10s%6s%s%s\n",
+           "trace", " valid", "idealheap", "maxheap", "util", "ops", "secs", "Kops",
+           show_extends ? " extends" : "", show_base ? "  vs base" : "");
     for (i = 0; i < n; i++) {
         if (stats[i].valid) {
-            printf("%35s%7s %8.0fk%7.0fk%5.0f%%%8.0f%10.6f%6.0f\n",
+            printf("%35s%7s %8.0fk%7.0fk%5.0f%%%8.0f%10.6f%6.0f",
                    stats[i].filename,
                    "yes",
                    (double)(stats[i].ideal_max_heap) / 1024.0,
@@ -970,9 +1398,16 @@ static void printresults(int n, stats_t *stats) {
                    stats[i].ops,
                    stats[i].secs,
                    (stats[i].ops / 1e3) / stats[i].secs);
+            if (show_extends)
+                printf("%8zu", stats[i].extensions);
+            if (show_base)
+                printf("%+8.1f%%", (stats[i].util - stats[i].base_util) * 100.0);
+            printf("\n");
             secs += stats[i].secs;
             ops += stats[i].ops;
             util += stats[i].util;
+            base_util += stats[i].base_util;
+            extensions += stats[i].extensions;
         } else {
             printf("%35s%10s%6s%8s%10s%6s\n",
                    "-",
@@ -986,13 +1421,18 @@ static void printresults(int n, stats_t *stats) {
 
     /* Print the aggregate results for the set of traces */
     if (errors == 0) {
-        printf("%42s%18s%5.0f%%%8.0f%10.6f%6.0f\n",
+        printf("%42s%18s%5.0f%%%8.0f%10.6f%6.0f",
                "Total       ",
                " ",
                (util / n) * 100.0,
                ops,
                secs,
                (ops / 1e3) / secs);
+        if (show_extends)
+            printf("%8zu", extensions);
+        if (show_base)
+            printf("%+8.1f%%", ((util - base_util) / n) * 100.0);
+        printf("\n");
     } else {
         printf("%35s%6s%8s%10s%6s\n",
                "Total       ",
@@ -1027,17 +1467,53 @@ void malloc_error(int tracenum, int opnum, char *msg) {
     printf("ERROR [trace %d, line %d]: %s\n", tracenum, LINENUM(opnum), msg);
 }
 
+/*
+ * configure_mm - Make the next mm_init use the tunables given for a
+ *     trace with -c, or else those given with -C
+ */
+static void configure_mm(char *tracefile) {
+    char *conf = mm_conf;
+    size_t len;
+    int i;
+
+    for (i = 0; i < num_trace_confs; i++) {
+        len = strchr(trace_confs[i], '=') - trace_confs[i];
+        if (strlen(tracefile) == len && !strncmp(trace_confs[i], tracefile, len))
+            conf = trace_confs[i] + len + 1;
+    }
+    mm_configure(conf);
+}
+
 /*
  * usage - Explain the command line arguments
  */
 static void usage(void) {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>] [-m <ms>] [-e <n>]\n");
+    fprintf(stderr, "               [-C <conf>] [-c <trace>=<conf>] [-B <conf>] [-H <n>] [-S]\n");
+    fprintf(stderr, "               [-P <file>] [-R]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-a         Don't check the team structure.\n");
+    fprintf(stderr, "\t-B <conf>  With -v, show how each trace's utilization differs from\n");
+    fprintf(stderr, "\t           a run tuned with <conf> instead, e.g. -C bidir:1 -B bidir:0\n");
+    fprintf(stderr, "\t-c <trace>=<conf>\n");
+    fprintf(stderr, "\t           Tune mm as with -C, for <trace> only.\n");
+    fprintf(stderr, "\t-C <conf>  Tune mm for every trace on top of MM_CONF, e.g.\n");
+    fprintf(stderr, "\t           chunk:131072,classes:16,small_threshold:96,min_block:48\n");
+    fprintf(stderr, "\t-e <n>     Also compare mm_free and regions on epochs of <n> requests.\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-H <n>     Allocate with mm_malloc_hint, hinting blocks the trace frees\n");
+    fprintf(stderr, "\t           within <n> requests as short lived and all others as long\n");
+    fprintf(stderr, "\t           lived. With -v, show how utilization differs from no hints.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-m <ms>    Run mm's maintenance thread every <ms> milliseconds.\n");
+    fprintf(stderr, "\t-P <file>  Save mm's live blocks at each trace's peak to <file> and\n");
+    fprintf(stderr, "\t           replay the trace pre-warmed from it. With -v, show how\n");
+    fprintf(stderr, "\t           utilization differs from a cold start.\n");
+    fprintf(stderr, "\t-R         Run the realloc-heavy traces instead of the default ones.\n");
+    fprintf(stderr, "\t-S         Allocate with mm_malloc_site, as if each request size had a\n");
+    fprintf(stderr, "\t           call site of its own, e.g. -S -C predict:1 -B predict:0\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
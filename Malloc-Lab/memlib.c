@@ -2,7 +2,29 @@
  * memlib.c - a module that simulates the memory system.  Needed because it 
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
+ *
+ *            Besides the brk heap, memlib hands out separate mappings
+ *            (mem_map) for blocks that should not live in the heap. It
+ *            keeps a table of them so the driver can check payloads
+ *            against them, and it never calls malloc itself.
+ *
+ *            Each brk heap is an area. mem_init sets up the default area
+ *            that mem_sbrk and friends work on; mem_area_create reserves
+ *            further, independent areas with their own brk. Distinct
+ *            areas may be grown from distinct threads: the area list and
+ *            the mapping table are guarded by mem_lock.
+ *
+ *            mem_area_open backs an area with a file instead. The file
+ *            starts with one page that records where the area was mapped
+ *            and how far its brk reached, so a later process can map the
+ *            same bytes back in, at the same address whenever it is free.
+ *
+ *            mem_area_open_shared does the same with a POSIX shared memory
+ *            object, sized once up front, that several processes map at
+ *            the one address its creator got. The area descriptor itself
+ *            lives in the header page, so every process sees one brk.
  */
+#define _GNU_SOURCE /* mremap */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -10,28 +32,96 @@
 #include <sys/mman.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
 
 #include "memlib.h"
 #include "config.h"
 
+/* one simulated brk heap */
+struct mem_area {
+    char *start_brk;             /* points to first byte of heap */
+    char *brk;                   /* points to last byte of heap */
+    char *max_addr;              /* largest legal heap address */
+    char *peak_brk;              /* highest value brk has reached */
+    size_t reserve;              /* bytes of address space reserved */
+    char *base;                  /* start of the reservation */
+    int fd;                      /* backing file, or -1 */
+    struct mem_file *file;       /* header page of the backing file */
+    char *file_end;              /* end of the part of the file mapped */
+    int shared;                  /* descriptor lives in its header page */
+    struct mem_area *next;       /* next area in mem_areas */
+};
+
+/* first page of a file backing an area */
+typedef struct mem_file {
+    uint64_t magic;              /* MEM_FILE_MAGIC */
+    uint64_t base;               /* address the file was last mapped at */
+    uint64_t size;               /* brk - start_brk when last changed */
+    struct mem_area area;        /* descriptor of a shared area */
+} mem_file_t;
+
+#define MEM_FILE_MAGIC 0x6d656d6c69624131ULL /* "memlibA1" */
+#define MEM_FILE_GROW (1 << 20)  /* granule the backing file grows by */
+#define MEM_SHARED_WAIT 10000    /* 100us polls for the creator of an object */
+
 /* private variables */
-static char *mem_start_brk;  /* points to first byte of heap */
-static char *mem_brk;        /* points to last byte of heap */
-static char *mem_max_addr;   /* largest legal heap address */ 
+static mem_area_t mem_default;   /* the area mem_sbrk works on */
+static mem_area_t *mem_areas;    /* every live area, for range checks */
+static mem_area_t *mem_free_descs; /* recycled area descriptors */
+static size_t mem_area_bytes;    /* sum of the sizes of all areas */
+static pthread_mutex_t mem_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* mappings handed out by mem_map, kept in an mmap'd table */
+typedef struct {
+    char *lo;                    /* first byte of the mapping */
+    size_t size;                 /* length of the mapping in bytes */
+} mem_mapping_t;
+
+static mem_mapping_t *mem_maps;  /* table of live mappings, sorted by lo */
+static size_t mem_map_count;     /* number of live mappings */
+static size_t mem_map_capacity;  /* number of entries the table can hold */
+static size_t mem_mapped_bytes;  /* sum of the sizes of the live mappings */
+static size_t mem_peak_bytes;    /* peak of heap size plus mapped bytes */
+
+static int mem_area_reserve(mem_area_t *area, size_t reserve);
+static char *mem_reserve(void *hint, size_t *reserve, size_t least, int shrink);
+static int mem_file_extend(mem_area_t *area);
+static mem_area_t *mem_new_desc(void);
+static mem_mapping_t *mem_find_mapping(void *addr);
+static void mem_insert_mapping(char *lo, size_t size);
+static void mem_remove_mapping(mem_mapping_t *m);
+static int mem_in_mapping(void *lo, void *hi);
+static void mem_update_peak(void);
 
 /* 
  * mem_init - initialize the memory system model
+ *    The storage is reserved with an anonymous private mapping, so pages
+ *    are only committed when first touched and can be handed back to the
+ *    kernel with madvise.
  */
 void mem_init(void)
 {
-    /* allocate the storage we will use to model the available VM */
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-	fprintf(stderr, "mem_init_vm: malloc error\n");
+    mem_init_reserve(0);
+}
+
+/*
+ * mem_init_reserve - mem_init with room for reserve bytes in the default
+ *    area (MAX_HEAP, or less if that much cannot be reserved, if 0)
+ */
+void mem_init_reserve(size_t reserve)
+{
+    /* reserve the storage we will use to model the available VM */
+    if (mem_area_reserve(&mem_default, reserve) < 0) {
+	fprintf(stderr, "mem_init_vm: mmap error\n");
 	exit(1);
     }
-
-    mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
-    mem_brk = mem_start_brk;                  /* heap is empty initially */
+    __atomic_store_n(&mem_peak_bytes,
+                     __atomic_load_n(&mem_area_bytes, __ATOMIC_RELAXED) +
+                     __atomic_load_n(&mem_mapped_bytes, __ATOMIC_RELAXED),
+                     __ATOMIC_RELAXED);
 }
 
 /* 
@@ -39,7 +129,17 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    mem_area_t **link;
+
+    pthread_mutex_lock(&mem_lock);
+    for (link = &mem_areas; *link != &mem_default; link = &(*link)->next)
+        ;
+    *link = mem_default.next;
+    pthread_mutex_unlock(&mem_lock);
+
+    __atomic_sub_fetch(&mem_area_bytes, mem_default.brk - mem_default.start_brk,
+                       __ATOMIC_RELAXED);
+    munmap(mem_default.start_brk, mem_default.reserve);
 }
 
 /*
@@ -47,33 +147,647 @@ void mem_deinit(void)
  */
 void mem_reset_brk()
 {
-    mem_brk = mem_start_brk;
+    mem_area_reset(&mem_default);
+}
+
+/*
+ * mem_area_reset - mem_reset_brk for an arbitrary area that is not kept
+ *    in a file. The pages stay mapped, so a heap rebuilt in the area does
+ *    not fault them in again.
+ */
+void mem_area_reset(mem_area_t *area)
+{
+    __atomic_sub_fetch(&mem_area_bytes, area->brk - area->start_brk,
+                       __ATOMIC_RELAXED);
+    area->brk = area->start_brk;
+    area->peak_brk = area->start_brk;
+    __atomic_store_n(&mem_peak_bytes,
+                     __atomic_load_n(&mem_area_bytes, __ATOMIC_RELAXED) +
+                     __atomic_load_n(&mem_mapped_bytes, __ATOMIC_RELAXED),
+                     __ATOMIC_RELAXED);
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    by incr bytes and returns the start address of the new area. A
+ *    negative incr shrinks the heap, and any whole pages above the new
+ *    brk are returned to the kernel.
+ */
+void *mem_sbrk(intptr_t incr) 
+{
+    return mem_area_sbrk(&mem_default, incr);
+}
+
+/*
+ * mem_area_create - reserve a new, empty area with room for reserve
+ *    bytes (MAX_HEAP, or less if that much cannot be reserved, if 0).
+ *    Returns NULL on failure.
  */
-void *mem_sbrk(int incr) 
+mem_area_t *mem_area_create(size_t reserve)
 {
-    char *old_brk = mem_brk;
+    mem_area_t *area;
+
+    pthread_mutex_lock(&mem_lock);
+    area = mem_new_desc();
+    if (area != NULL && mem_area_reserve(area, reserve) < 0) {
+        area->next = mem_free_descs;
+        mem_free_descs = area;
+        area = NULL;
+    }
+    pthread_mutex_unlock(&mem_lock);
+    return area;
+}
+
+/*
+ * mem_area_open - map the area kept in the file at path, creating an
+ *    empty one if the file is empty or missing. The area is mapped at
+ *    the address it had last time if that range is free; its brk comes
+ *    back where it was. Returns NULL on failure or if the file does not
+ *    hold an area.
+ */
+mem_area_t *mem_area_open(const char *path, size_t reserve)
+{
+    size_t page = mem_pagesize();
+    mem_file_t header = {0};
+    mem_area_t *area;
+    struct stat st;
+    size_t length;
+    char *base;
+    int fd, shrink;
+
+    if ((fd = open(path, O_RDWR | O_CREAT, 0600)) < 0)
+        return NULL;
+    if (fstat(fd, &st) < 0 || (st.st_size > 0 &&
+        (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+         header.magic != MEM_FILE_MAGIC))) {
+        close(fd);
+        return NULL;
+    }
+    if (st.st_size == 0 && ftruncate(fd, page) < 0) {
+        close(fd);
+        return NULL;
+    }
+    length = st.st_size > (off_t)page ? (size_t)st.st_size : page;
+    shrink = reserve == 0;
+    reserve = page + (shrink ? MAX_HEAP : reserve);
+    while (shrink && reserve < 2 * length)   /* a file past the default */
+        reserve *= 2;                        /* still has room to grow */
+
+    /* The recorded address is only a hint: any free range will do */
+    base = mem_reserve((void *)(uintptr_t)header.base, &reserve, length, shrink);
+    if (base == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    if (length > reserve || mmap(base, length, PROT_READ | PROT_WRITE,
+                                 MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(base, reserve);
+        close(fd);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&mem_lock);
+    if ((area = mem_new_desc()) == NULL) {
+        pthread_mutex_unlock(&mem_lock);
+        munmap(base, reserve);
+        close(fd);
+        return NULL;
+    }
+    area->base = base;
+    area->reserve = reserve;
+    area->fd = fd;
+    area->file = (mem_file_t *)base;
+    area->file_end = base + length;
+    area->shared = 0;
+    area->file->magic = MEM_FILE_MAGIC;
+    area->file->base = (uintptr_t)base;
+    area->start_brk = base + page;
+    area->brk = area->start_brk + area->file->size;
+    area->peak_brk = area->brk;
+    area->max_addr = base + reserve;
+    area->next = mem_areas;
+    mem_areas = area;
+    pthread_mutex_unlock(&mem_lock);
+
+    __atomic_add_fetch(&mem_area_bytes, area->brk - area->start_brk,
+                       __ATOMIC_RELAXED);
+    mem_update_peak();
+    return area;
+}
+
+/*
+ * mem_area_open_shared - map the shared memory object name, creating it
+ *    with room for reserve bytes (SHARED_HEAP if 0) if it does not exist;
+ *    fails rather than size it past the free space of its file system,
+ *    where a touch of the missing pages would raise SIGBUS.
+ *    *created tells whether this call made it. An existing object has to
+ *    be mapped at the address its creator got; returns NULL if that
+ *    range is taken here, or on any other failure.
+ */
+mem_area_t *mem_area_open_shared(const char *name, size_t reserve, int *created)
+{
+    size_t page = mem_pagesize();
+    mem_file_t header;
+    mem_area_t *area;
+    struct statvfs fs;
+    struct stat st;
+    char *base;
+    int fd, i;
+
+    if ((fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600)) >= 0) {
+        reserve = page + (reserve ? reserve : SHARED_HEAP);
+        if (fstatvfs(fd, &fs) < 0 ||
+            reserve / fs.f_frsize > fs.f_bavail ||
+            ftruncate(fd, reserve) < 0 ||
+            (base = mmap(NULL, reserve, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_NORESERVE, fd, 0)) == MAP_FAILED) {
+            close(fd);
+            shm_unlink(name);
+            return NULL;
+        }
+        close(fd);
+
+        area = &((mem_file_t *)base)->area;
+        area->base = base;
+        area->reserve = reserve;
+        area->fd = -1;
+        area->file = (mem_file_t *)base;
+        area->file_end = base + reserve;
+        area->shared = 1;
+        area->start_brk = base + page;
+        area->brk = area->start_brk;
+        area->peak_brk = area->brk;
+        area->max_addr = base + reserve;
+        area->next = NULL;
+        area->file->base = (uintptr_t)base;
+        area->file->size = 0;
+
+        /* attachers map the object once the magic shows up */
+        __atomic_store_n(&area->file->magic, MEM_FILE_MAGIC, __ATOMIC_RELEASE);
+        *created = 1;
+        return area;
+    }
+
+    if (errno != EEXIST || (fd = shm_open(name, O_RDWR, 0)) < 0)
+        return NULL;
+
+    for (i = 0; pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+                header.magic != MEM_FILE_MAGIC; i++) {
+        if (i == MEM_SHARED_WAIT) {
+            close(fd);
+            return NULL;
+        }
+        usleep(100);
+    }
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return NULL;
+    }
+
+    base = mmap((void *)(uintptr_t)header.base, st.st_size,
+                PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_NORESERVE | MAP_FIXED_NOREPLACE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return NULL;
+    if (base != (char *)(uintptr_t)header.base) {
+        munmap(base, st.st_size);
+        return NULL;
+    }
 
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
+    *created = 0;
+    return &((mem_file_t *)base)->area;
+}
+
+/*
+ * mem_area_destroy - give an area and all of its pages back. The
+ *    default area can only be released through mem_deinit. A file
+ *    backed area is written back and unmapped; the file stays. A
+ *    shared area is only unmapped from this process.
+ */
+void mem_area_destroy(mem_area_t *area)
+{
+    mem_area_t **link;
+
+    if (area == &mem_default)
+        return;
+
+    /* the descriptor goes with the mapping, other processes still use it */
+    if (area->shared) {
+        munmap(area->base, area->reserve);
+        return;
+    }
+
+    __atomic_sub_fetch(&mem_area_bytes, area->brk - area->start_brk,
+                       __ATOMIC_RELAXED);
+    if (area->file != NULL) {
+        msync(area->base, area->file_end - area->base, MS_SYNC);
+        close(area->fd);
+    }
+    munmap(area->base, area->reserve);
+
+    pthread_mutex_lock(&mem_lock);
+    for (link = &mem_areas; *link != area; link = &(*link)->next)
+        ;
+    *link = area->next;
+    area->next = mem_free_descs;
+    mem_free_descs = area;
+    pthread_mutex_unlock(&mem_lock);
+}
+
+/*
+ * mem_area_sbrk - mem_sbrk for an arbitrary area. Only one thread may
+ *    grow or shrink a given area at a time.
+ */
+void *mem_area_sbrk(mem_area_t *area, intptr_t incr)
+{
+    char *old_brk = area->brk;
+
+    if (((area->brk + incr) < area->start_brk) || ((area->brk + incr) > area->max_addr)) {
 	errno = ENOMEM;
 	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
 	return (void *)-1;
     }
-    mem_brk += incr;
+    area->brk += incr;
+    if (area->file != NULL) {
+        if (area->brk > area->file_end && mem_file_extend(area) < 0) {
+            area->brk = old_brk;
+            errno = ENOMEM;
+            fprintf(stderr, "ERROR: mem_sbrk failed. Could not grow the file...\n");
+            return (void *)-1;
+        }
+        area->file->size = area->brk - area->start_brk;
+    }
+    if (!area->shared)
+        __atomic_add_fetch(&mem_area_bytes, incr, __ATOMIC_RELAXED);
+
+    if (incr < 0)
+        mem_decommit(area->brk, old_brk - area->brk);
+    else if (area->brk > area->peak_brk)
+        area->peak_brk = area->brk;
+    mem_update_peak();
+
     return (void *)old_brk;
 }
 
+/*
+ * mem_area_lo - return address of the first byte of an area
+ */
+void *mem_area_lo(mem_area_t *area)
+{
+    return (void *)area->start_brk;
+}
+
+/*
+ * mem_area_hi - return address of the last byte of an area
+ */
+void *mem_area_hi(mem_area_t *area)
+{
+    return (void *)(area->brk - 1);
+}
+
+/*
+ * mem_area_size - return the size of an area in bytes
+ */
+size_t mem_area_size(mem_area_t *area)
+{
+    return (size_t)(area->brk - area->start_brk);
+}
+
+/*
+ * mem_default_area - return the area mem_sbrk works on
+ */
+mem_area_t *mem_default_area(void)
+{
+    return &mem_default;
+}
+
+/*
+ * mem_area_reserve - reserve the address space of an empty area, reserve
+ *    bytes or MAX_HEAP if 0, and add it to mem_areas. The caller holds
+ *    mem_lock.
+ */
+static int mem_area_reserve(mem_area_t *area, size_t reserve)
+{
+    int shrink = reserve == 0;
+
+    reserve = shrink ? MAX_HEAP : reserve;
+    area->start_brk = mem_reserve(NULL, &reserve, 0, shrink);
+    if (area->start_brk == MAP_FAILED)
+        return -1;
+
+    area->max_addr = area->start_brk + reserve;  /* max legal heap address */
+    area->brk = area->start_brk;                 /* heap is empty initially */
+    area->peak_brk = area->start_brk;
+    area->reserve = reserve;
+    area->base = area->start_brk;
+    area->fd = -1;
+    area->file = NULL;
+    area->file_end = NULL;
+    area->shared = 0;
+    area->next = mem_areas;
+    mem_areas = area;
+    return 0;
+}
+
+/*
+ * mem_reserve - map *reserve bytes of address space, at hint if that
+ *    range is free. With shrink set, a failed mmap is retried with half
+ *    the size, down to MIN_HEAP but never below least bytes, so a tight
+ *    ulimit -v still gets a smaller heap. Sets *reserve to the size
+ *    mapped; returns MAP_FAILED if nothing could be.
+ */
+static char *mem_reserve(void *hint, size_t *reserve, size_t least, int shrink)
+{
+    char *base;
+
+    while ((base = mmap(hint, *reserve, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0)) == MAP_FAILED &&
+           shrink && *reserve / 2 >= MIN_HEAP && *reserve / 2 >= least)
+        *reserve /= 2;
+    return base;
+}
+
+/*
+ * mem_file_extend - grow the backing file of an area, in MEM_FILE_GROW
+ *    steps, until it covers the brk, and map the new part
+ */
+static int mem_file_extend(mem_area_t *area)
+{
+    size_t length = area->brk - area->base;
+
+    length = (length + MEM_FILE_GROW - 1) & ~(size_t)(MEM_FILE_GROW - 1);
+    if (length > area->reserve)
+        length = area->reserve;
+    if (ftruncate(area->fd, length) < 0 ||
+        mmap(area->file_end, area->base + length - area->file_end,
+             PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, area->fd,
+             area->file_end - area->base) == MAP_FAILED)
+        return -1;
+    area->file_end = area->base + length;
+    return 0;
+}
+
+/*
+ * mem_new_desc - take an area descriptor from the free list, carving
+ *    a fresh page into descriptors when it runs dry. The caller holds
+ *    mem_lock.
+ */
+static mem_area_t *mem_new_desc(void)
+{
+    mem_area_t *area;
+
+    if (mem_free_descs == NULL) {
+        size_t i, count = mem_pagesize() / sizeof(mem_area_t);
+        mem_area_t *page = mmap(NULL, mem_pagesize(), PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (page == MAP_FAILED)
+            return NULL;
+        for (i = 0; i < count; i++) {
+            page[i].next = mem_free_descs;
+            mem_free_descs = &page[i];
+        }
+    }
+
+    area = mem_free_descs;
+    mem_free_descs = area->next;
+    return area;
+}
+
+/*
+ * mem_decommit - release the physical pages that lie entirely inside
+ *    [addr, addr + len). The range stays mapped; touching it again
+ *    faults in fresh zero-filled pages. Returns the number of bytes
+ *    released.
+ */
+size_t mem_decommit(void *addr, size_t len)
+{
+    uintptr_t pagemask = mem_pagesize() - 1;
+    uintptr_t lo = ((uintptr_t)addr + pagemask) & ~pagemask;
+    uintptr_t hi = ((uintptr_t)addr + len) & ~pagemask;
+
+    if (hi <= lo)
+        return 0;
+
+    if (madvise((void *)lo, hi - lo, MADV_DONTNEED) < 0)
+        return 0;
+
+    return hi - lo;
+}
+
+/*
+ * mem_protect - make the pages in [addr, addr + len) readable and
+ *    writable, or inaccessible if access is 0, so that touching them
+ *    faults. addr must be page aligned. Returns 0 on success, -1 on
+ *    failure.
+ */
+int mem_protect(void *addr, size_t len, int access)
+{
+    return mprotect(addr, len, access ? PROT_READ | PROT_WRITE : PROT_NONE);
+}
+
+/*
+ * mem_map - map size bytes of fresh zero-filled memory outside the brk
+ *    heap. Returns the start of the mapping, or NULL on failure.
+ */
+void *mem_map(size_t size)
+{
+    char *lo;
+
+    lo = mmap(NULL, size, PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (lo == MAP_FAILED) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    pthread_mutex_lock(&mem_lock);
+    if (mem_map_count == mem_map_capacity) {
+        /* grow the table without going through malloc */
+        size_t capacity = mem_map_capacity ? 2 * mem_map_capacity : 256;
+        mem_mapping_t *maps = mmap(NULL, capacity * sizeof(mem_mapping_t),
+                                   PROT_READ | PROT_WRITE,
+                                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (maps == MAP_FAILED) {
+            pthread_mutex_unlock(&mem_lock);
+            munmap(lo, size);
+            return NULL;
+        }
+        if (mem_maps != NULL) {
+            memcpy(maps, mem_maps, mem_map_count * sizeof(mem_mapping_t));
+            munmap(mem_maps, mem_map_capacity * sizeof(mem_mapping_t));
+        }
+        mem_maps = maps;
+        mem_map_capacity = capacity;
+    }
+
+    mem_insert_mapping(lo, size);
+    __atomic_add_fetch(&mem_mapped_bytes, size, __ATOMIC_RELAXED);
+    mem_update_peak();
+    pthread_mutex_unlock(&mem_lock);
+    return lo;
+}
+
+/*
+ * mem_unmap - give back a mapping obtained from mem_map or mem_remap.
+ *    Returns 0 on success, -1 if addr is not the start of a mapping.
+ */
+int mem_unmap(void *addr)
+{
+    mem_mapping_t *m;
+
+    pthread_mutex_lock(&mem_lock);
+    m = mem_find_mapping(addr);
+    if (m == NULL || m->lo != addr) {
+        pthread_mutex_unlock(&mem_lock);
+        return -1;
+    }
+
+    munmap(m->lo, m->size);
+    __atomic_sub_fetch(&mem_mapped_bytes, m->size, __ATOMIC_RELAXED);
+    mem_remove_mapping(m);
+    pthread_mutex_unlock(&mem_lock);
+    return 0;
+}
+
+/*
+ * mem_remap - resize a mapping to new_size bytes, moving it if it cannot
+ *    grow in place. The contents are carried over by the kernel without
+ *    copying. Returns the (possibly new) start, or NULL on failure.
+ */
+void *mem_remap(void *addr, size_t new_size)
+{
+    mem_mapping_t *m;
+    char *lo = NULL;
+
+    pthread_mutex_lock(&mem_lock);
+    m = mem_find_mapping(addr);
+    if (m != NULL && m->lo == addr) {
+        lo = mremap(m->lo, m->size, new_size, MREMAP_MAYMOVE);
+        if (lo == MAP_FAILED) {
+            errno = ENOMEM;
+            lo = NULL;
+        } else {
+            __atomic_add_fetch(&mem_mapped_bytes, new_size - m->size,
+                               __ATOMIC_RELAXED);
+            /* a moved mapping takes its place in the sorted table */
+            mem_remove_mapping(m);
+            mem_insert_mapping(lo, new_size);
+            mem_update_peak();
+        }
+    }
+    pthread_mutex_unlock(&mem_lock);
+    return lo;
+}
+
+/*
+ * mem_is_mapped - return true if [lo, hi] lies inside a single mapping
+ */
+int mem_is_mapped(void *lo, void *hi)
+{
+    int found;
+
+    pthread_mutex_lock(&mem_lock);
+    found = mem_in_mapping(lo, hi);
+    pthread_mutex_unlock(&mem_lock);
+    return found;
+}
+
+/*
+ * mem_is_area - return true if [lo, hi] lies below the brk of a single area
+ */
+int mem_is_area(void *lo, void *hi)
+{
+    mem_area_t *area;
+    int found = 0;
+
+    pthread_mutex_lock(&mem_lock);
+    for (area = mem_areas; area != NULL && !found; area = area->next)
+        found = (char *)lo >= area->start_brk && (char *)hi < area->brk;
+    pthread_mutex_unlock(&mem_lock);
+    return found;
+}
+
+/*
+ * mem_in_mapping - mem_is_mapped with mem_lock already held
+ */
+static int mem_in_mapping(void *lo, void *hi)
+{
+    mem_mapping_t *m = mem_find_mapping(lo);
+
+    return m != NULL && (char *)hi < m->lo + m->size;
+}
+
+/*
+ * mem_find_mapping - return the table entry of the mapping holding addr,
+ *    found by binary search. The caller holds mem_lock.
+ */
+static mem_mapping_t *mem_find_mapping(void *addr)
+{
+    size_t lo = 0, hi = mem_map_count;
+
+    /* find the last mapping that starts at or below addr */
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (mem_maps[mid].lo <= (char *)addr)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo > 0 && (char *)addr < mem_maps[lo - 1].lo + mem_maps[lo - 1].size)
+        return &mem_maps[lo - 1];
+    return NULL;
+}
+
+/*
+ * mem_insert_mapping - add [lo, lo + size) to mem_maps in address order.
+ *    The caller holds mem_lock and made room for one more entry.
+ */
+static void mem_insert_mapping(char *lo, size_t size)
+{
+    size_t i = mem_map_count;
+
+    while (i > 0 && mem_maps[i - 1].lo > lo)
+        i--;
+    memmove(&mem_maps[i + 1], &mem_maps[i],
+            (mem_map_count - i) * sizeof(mem_mapping_t));
+    mem_maps[i].lo = lo;
+    mem_maps[i].size = size;
+    mem_map_count++;
+}
+
+/*
+ * mem_remove_mapping - drop an entry of mem_maps, keeping the rest in
+ *    order. The caller holds mem_lock.
+ */
+static void mem_remove_mapping(mem_mapping_t *m)
+{
+    memmove(m, m + 1, (mem_maps + --mem_map_count - m) * sizeof(mem_mapping_t));
+}
+
+/*
+ * mem_update_peak - fold the current footprint into the recorded peak.
+ *    Lock free, as areas grow from any thread without mem_lock.
+ */
+static void mem_update_peak(void)
+{
+    size_t bytes = __atomic_load_n(&mem_area_bytes, __ATOMIC_RELAXED) +
+                   __atomic_load_n(&mem_mapped_bytes, __ATOMIC_RELAXED);
+    size_t peak = __atomic_load_n(&mem_peak_bytes, __ATOMIC_RELAXED);
+
+    while (bytes > peak &&
+           !__atomic_compare_exchange_n(&mem_peak_bytes, &peak, bytes, 0,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
 void *mem_heap_lo()
 {
-    return (void *)mem_start_brk;
+    return mem_area_lo(&mem_default);
 }
 
 /* 
@@ -81,7 +795,7 @@ void *mem_heap_lo()
  */
 void *mem_heap_hi()
 {
-    return (void *)(mem_brk - 1);
+    return mem_area_hi(&mem_default);
 }
 
 /*
@@ -89,7 +803,33 @@ void *mem_heap_hi()
  */
 size_t mem_heapsize() 
 {
-    return (size_t)(mem_brk - mem_start_brk);
+    return mem_area_size(&mem_default);
+}
+
+/*
+ * mem_peak_heapsize() - returns the largest heap size in bytes since the
+ *    last mem_reset_brk
+ */
+size_t mem_peak_heapsize()
+{
+    return (size_t)(mem_default.peak_brk - mem_default.start_brk);
+}
+
+/*
+ * mem_mapsize() - returns the number of bytes currently handed out by mem_map
+ */
+size_t mem_mapsize()
+{
+    return __atomic_load_n(&mem_mapped_bytes, __ATOMIC_RELAXED);
+}
+
+/*
+ * mem_peak_footprint() - returns the largest total size of all areas
+ *    plus mapped bytes since the last mem_reset_brk
+ */
+size_t mem_peak_footprint()
+{
+    return __atomic_load_n(&mem_peak_bytes, __ATOMIC_RELAXED);
 }
 
 /*
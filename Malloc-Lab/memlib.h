@@ -1,12 +1,42 @@
 #include <unistd.h>
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct mem_area mem_area_t;
+
 void mem_init(void);               
+void mem_init_reserve(size_t reserve);
 void mem_deinit(void);
-void *mem_sbrk(int incr);
+void *mem_sbrk(intptr_t incr);
 void mem_reset_brk(void); 
+size_t mem_decommit(void *addr, size_t len);
+int mem_protect(void *addr, size_t len, int access);
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+size_t mem_peak_heapsize(void);
+mem_area_t *mem_area_create(size_t reserve);
+mem_area_t *mem_area_open(const char *path, size_t reserve);
+mem_area_t *mem_area_open_shared(const char *name, size_t reserve, int *created);
+void mem_area_destroy(mem_area_t *area);
+void *mem_area_sbrk(mem_area_t *area, intptr_t incr);
+void mem_area_reset(mem_area_t *area);
+void *mem_area_lo(mem_area_t *area);
+void *mem_area_hi(mem_area_t *area);
+size_t mem_area_size(mem_area_t *area);
+mem_area_t *mem_default_area(void);
+void *mem_map(size_t size);
+int mem_unmap(void *addr);
+void *mem_remap(void *addr, size_t new_size);
+int mem_is_mapped(void *lo, void *hi);
+int mem_is_area(void *lo, void *hi);
+size_t mem_mapsize(void);
+size_t mem_peak_footprint(void);
 size_t mem_pagesize(void);
 
+#ifdef __cplusplus
+}
+#endif
@@ -1,9 +1,97 @@
 #include <stdio.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 extern int mm_init (void);
+extern int mm_configure(const char *conf);
 extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
+extern void mm_free_sized(void *ptr, size_t size);
 extern void *mm_realloc(void *ptr, size_t size);
+extern void *mm_memalign(size_t alignment, size_t size);
+extern size_t mm_usable_size(void *ptr);
+extern void *mm_malloc_isolated(size_t size);
+
+/* Hints for mm_malloc_hint, or'ed together */
+#define MM_HINT_SHORT 1 /* Freed soon, e.g. at the end of a request */
+#define MM_HINT_LONG 2  /* Kept for a session or for good */
+#define MM_HINT_COLD 4  /* Rarely touched once written */
+
+extern void *mm_malloc_hint(size_t size, int hints);
+extern void *mm_malloc_site(size_t size, const void *site);
+extern void mm_free_isolated(void *ptr);
+extern void mm_checkheap(int verbose);
+extern int mm_trim(size_t pad);
+extern int mm_maint_start(unsigned int intervalMs);
+extern void mm_maint_stop(void);
+extern void mm_maint_kick(void);
+
+/* Growth of the default heap since mm_init, from mm_get_stats */
+typedef struct {
+    size_t extensions;    /* times it grew */
+    size_t extendedBytes; /* bytes it grew by */
+    size_t heapBytes;     /* its size now */
+} mm_stats_t;
+
+extern void mm_get_stats(mm_stats_t *stats);
+extern int mm_profile_load(const char *path);
+extern int mm_profile_save(const char *path);
+extern int mm_epoch_enter(void);
+extern void mm_epoch_exit(void);
+extern void mm_retire(void *ptr);
+
+typedef struct mm_heap mm_heap_t;
+
+extern mm_heap_t *mm_heap_create(void);
+extern void mm_heap_destroy(mm_heap_t *heap);
+extern void *mm_heap_malloc(mm_heap_t *heap, size_t size);
+extern void mm_heap_free(mm_heap_t *heap, void *ptr);
+extern void mm_heap_free_sized(mm_heap_t *heap, void *ptr, size_t size);
+extern void *mm_heap_realloc(mm_heap_t *heap, void *ptr, size_t size);
+extern void *mm_heap_memalign(mm_heap_t *heap, size_t alignment, size_t size);
+extern void *mm_heap_malloc_isolated(mm_heap_t *heap, size_t size);
+extern int mm_heap_trim(mm_heap_t *heap, size_t pad);
+
+typedef struct mm_region mm_region_t;
+
+/* Position in a region returned by mm_region_mark */
+typedef struct {
+    void *chunk;
+    char *top;
+} mm_region_mark_t;
+
+extern mm_region_t *mm_region_create(mm_heap_t *heap);
+extern void *mm_region_alloc(mm_region_t *region, size_t size);
+extern mm_region_mark_t mm_region_mark(mm_region_t *region);
+extern void mm_region_release(mm_region_t *region, mm_region_mark_t mark);
+extern void mm_region_destroy(mm_region_t *region);
+
+typedef struct mm_cache mm_cache_t;
+
+extern mm_cache_t *mm_cache_create(size_t size, size_t align,
+                                   void (*ctor)(void *), void (*dtor)(void *));
+extern void *mm_cache_alloc(mm_cache_t *cache);
+extern void mm_cache_free(mm_cache_t *cache, void *obj);
+extern void mm_cache_destroy(mm_cache_t *cache);
+
+typedef struct mm_handle *mm_handle_t;
+
+extern mm_handle_t mm_halloc(size_t size);
+extern void *mm_hlock(mm_handle_t handle);
+extern void mm_hunlock(mm_handle_t handle);
+extern void mm_hfree(mm_handle_t handle);
+extern size_t mm_compact(void);
+
+extern int mm_persist_open(const char *path);
+extern void **mm_persist_root(void);
+extern void mm_persist_close(void);
+
+extern mm_heap_t *mm_shared_open(const char *name, size_t size);
+extern void mm_shared_close(mm_heap_t *heap);
+extern size_t mm_shared_offset(mm_heap_t *heap, void *ptr);
+extern void *mm_shared_pointer(mm_heap_t *heap, size_t offset);
 
 
 /*
@@ -20,3 +108,7 @@ typedef struct {
 } team_t;
 
 extern team_t team;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,117 @@
+/*
+ * mm.hpp - C++ adapters for mm: a std::pmr::memory_resource and an
+ *          allocator template, both bound to one heap
+ *
+ *    mm::resource res;                     // the default heap
+ *    std::pmr::vector<int> v(&res);
+ *
+ *    mm::allocator<int> alloc(heap);       // a heap from mm_heap_create
+ *    std::vector<int, mm::allocator<int>> w(alloc);
+ *
+ * Deallocation always knows the size, so it goes through
+ * mm_heap_free_sized. Like the heaps themselves, neither is thread-safe.
+ */
+#ifndef MM_HPP
+#define MM_HPP
+
+#include <cstddef>
+#include <limits>
+#include <memory_resource>
+#include <new>
+
+#include "mm.h"
+
+namespace mm {
+
+/*
+ * allocate - size bytes at a multiple of alignment from heap (The default
+ *    heap if nullptr), throwing std::bad_alloc when out of memory
+ */
+inline void *allocate(mm_heap_t *heap, std::size_t size, std::size_t alignment) {
+    void *p;
+
+    if (size == 0)
+        size = 1;
+    p = heap != nullptr ? mm_heap_memalign(heap, alignment, size)
+                        : mm_memalign(alignment, size);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+/*
+ * deallocate - give back a block allocate returned for size bytes
+ */
+inline void deallocate(mm_heap_t *heap, void *p, std::size_t size) {
+    if (size == 0)
+        size = 1;
+    if (heap != nullptr)
+        mm_heap_free_sized(heap, p, size);
+    else
+        mm_free_sized(p, size);
+}
+
+/* A memory resource handing out blocks of one heap */
+class resource : public std::pmr::memory_resource {
+public:
+    explicit resource(mm_heap_t *heap = nullptr) noexcept : heap_(heap) {}
+
+    mm_heap_t *heap() const noexcept { return heap_; }
+
+private:
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+        return mm::allocate(heap_, bytes, alignment);
+    }
+
+    void do_deallocate(void *p, std::size_t bytes, std::size_t) override {
+        mm::deallocate(heap_, p, bytes);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+        const resource *r = dynamic_cast<const resource *>(&other);
+        return r != nullptr && r->heap_ == heap_;
+    }
+
+    mm_heap_t *heap_;   /* nullptr for the default heap */
+};
+
+/* A standard allocator for objects of type T in one heap */
+template <typename T>
+class allocator {
+public:
+    typedef T value_type;
+
+    allocator() noexcept : heap_(nullptr) {}
+    explicit allocator(mm_heap_t *heap) noexcept : heap_(heap) {}
+    template <typename U>
+    allocator(const allocator<U> &other) noexcept : heap_(other.heap()) {}
+
+    T *allocate(std::size_t n) {
+        if (n > std::numeric_limits<std::size_t>::max() / sizeof(T))
+            throw std::bad_array_new_length();
+        return static_cast<T *>(mm::allocate(heap_, n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *p, std::size_t n) noexcept {
+        mm::deallocate(heap_, p, n * sizeof(T));
+    }
+
+    mm_heap_t *heap() const noexcept { return heap_; }
+
+private:
+    mm_heap_t *heap_;   /* nullptr for the default heap */
+};
+
+template <typename T, typename U>
+bool operator==(const allocator<T> &a, const allocator<U> &b) noexcept {
+    return a.heap() == b.heap();
+}
+
+template <typename T, typename U>
+bool operator!=(const allocator<T> &a, const allocator<U> &b) noexcept {
+    return a.heap() != b.heap();
+}
+
+} // namespace mm
+
+#endif /* MM_HPP */
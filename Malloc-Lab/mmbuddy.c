@@ -0,0 +1,584 @@
+/*
+ * mmbuddy.c - Binary buddy allocator, a drop-in replacement for mm.o
+ *
+ *        255                  128 127                   64 63             7 6         1   0
+ *        |                      | |                      | |               | |         |   |
+ *         ---------------------------------------------------------------------------------      <--------  Free block (buddy_t)
+ *        |          prev          |          next          |     unused    |   order   | a/f |
+ *         ---------------------------------------------------------------------------------
+ *
+ *        - Every block is 2^order bytes, from MIN_ORDER up, and starts at an offset from the start of the arena
+ *          that is a multiple of its size, so the buddy it was split from or merges with sits at offset ^ 2^order
+ *        - Only the 8 byte header is kept, there is no footer: a block never needs to find its lower neighbour,
+ *          only its buddy, whose header is found from the address alone
+ *
+ *        - Free lists:
+ *          - One doubly linked list per order, a request takes the head of the smallest nonempty list that fits
+ *            and splits it in halves down to its own order, putting every upper half back on its list
+ *          - nonEmpty is a bitmap with bit k set while list k has a block, so that list is one count trailing
+ *            zeros away instead of a scan over the empty ones
+ *          - A free merges the block with its buddy for as long as the buddy is free and whole (same order)
+ *
+ *        - The arena:
+ *          - Grows from the default memlib area with mem_sbrk, so mdriver measures it like mm.c
+ *          - A block of order k can only start at a multiple of 2^k, so when the top of the arena is not aligned
+ *            for a new block the gap is first filled with free blocks of increasing order
+ *          - The top of the arena does not have to be a power of 2, a buddy above it just does not exist yet
+ *
+ *        - Trade off against mm.c:
+ *          - Allocating, splitting and merging are O(log n) pointer operations with no searching, and realloc grows
+ *            in place by swallowing free upper buddies
+ *          - Every request is rounded up to a power of 2, so workloads that are not dominated by power of 2 sizes
+ *            lose up to half of every block to internal fragmentation
+ *
+ *        - Only the interface mdriver uses is provided: mm_init, mm_malloc, mm_free, mm_realloc and mm_checkheap,
+ *          plus mm_get_stats and mm_configure, mm_malloc_hint, mm_malloc_site, mm_profile_load, mm_trim and maintenance entry points that do nothing. Regions, caches, handles and
+ *          the other extensions of mm.c need its boundary tags and are not part of this backend
+ *
+ *        - Built into mdriver-buddy by make mdriver-buddy, which links this file in place of mm.o
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+/* Constants and macros */
+#define MIN_ORDER 5    /* Smallest block, 32 bytes: the header and both list pointers */
+#define MAX_ORDER 47   /* Largest block, as large as the 48 bit block sizes of mm.c */
+#define ORDERS (MAX_ORDER + 1)
+
+#define BLOCK_SIZE(order) ((size_t)1 << (order))
+
+typedef struct buddy_t
+{
+    size_t allocated : 1;
+    size_t order : 6;
+    size_t _ : 57;
+
+    union
+    {
+        struct
+        {
+            struct buddy_t* next;
+            struct buddy_t* prev;
+        };
+
+        char payload[0];
+    };
+} buddy_t;
+
+/* Global variables */
+static char* arenaStart;               /* First byte of the arena, every offset is taken from here */
+static size_t arenaSize;               /* Bytes obtained from mem_sbrk so far */
+static size_t arenaGrowths;            /* Times growArena called mem_sbrk */
+static buddy_t* freeLists[ORDERS];     /* Heads of the free lists, one per order */
+static uint64_t nonEmpty;              /* Bit k is set while freeLists[k] is not empty */
+
+team_t team = {
+    /* First and last name */
+    "Aditya Patil",
+    /* UID */
+    "XXXXXXXXX",
+    /* Custom message (16 chars) */
+    "Pls give me an A",
+};
+
+/* Function prototypes for internal helper routines */
+static int orderOf(size_t size);
+static buddy_t* payloadToBlock(void* payload);
+static buddy_t* buddyOf(buddy_t* block, int order);
+static void insertBlock(buddy_t* block, int order);
+static void removeBlock(buddy_t* block);
+static buddy_t* splitBlock(buddy_t* block, int order, int want);
+static void mergeBlock(buddy_t* block);
+static buddy_t* growArena(int order);
+
+/*
+ * mm_init - Start an empty arena at the current top of the default area
+ */
+/* $begin mm_init */
+int mm_init(void)
+{
+    arenaStart = mem_sbrk(0);
+    arenaSize = 0;
+    arenaGrowths = 0;
+    memset(freeLists, 0, sizeof(freeLists));
+    nonEmpty = 0;
+
+    return 0;
+} /* $end mm_init */
+
+/*
+ * mm_configure - The buddy backend has no tunables, only an empty configuration is accepted
+ */
+/* $begin mm_configure */
+int mm_configure(const char* conf)
+{
+    return (conf == NULL || *conf == '\0') ? 0 : -1;
+} /* $end mm_configure */
+
+/*
+ * mm_malloc - Take the smallest free block of a large enough order and split it down to size
+ */
+/* $begin mm_malloc */
+void* mm_malloc(size_t size)
+{
+    buddy_t* block;
+    int order;
+    int found;
+
+    if (size == 0 || (order = orderOf(size)) < 0)
+    {
+        return NULL;
+    }
+
+    if ((nonEmpty >> order) != 0)
+    {
+        found = order + __builtin_ctzll(nonEmpty >> order);
+        block = freeLists[found];
+        removeBlock(block);
+        block = splitBlock(block, found, order);
+    }
+    else if ((block = growArena(order)) == NULL)
+    {
+        return NULL;
+    }
+
+    block->allocated = true;
+
+    return block->payload;
+} /* $end mm_malloc */
+
+/*
+ * mm_malloc_hint - Blocks are placed by size alone, the hints make no difference
+ */
+/* $begin mm_malloc_hint */
+void* mm_malloc_hint(size_t size, int hints)
+{
+    (void)hints;
+
+    return mm_malloc(size);
+} /* $end mm_malloc_hint */
+
+/*
+ * mm_malloc_site - Nor does the allocation site
+ */
+/* $begin mm_malloc_site */
+void* mm_malloc_site(size_t size, const void* site)
+{
+    (void)site;
+
+    return mm_malloc(size);
+} /* $end mm_malloc_site */
+
+/*
+ * mm_free - Merge the block with its free buddies and put the result back on its list
+ */
+/* $begin mm_free */
+void mm_free(void* ptr)
+{
+    if (ptr == NULL)
+    {
+        return;
+    }
+
+    mergeBlock(payloadToBlock(ptr));
+} /* $end mm_free */
+
+/*
+ * mm_realloc - Grow in place while the block is the lower half of a free buddy, or else move it
+ */
+/* $begin mm_realloc */
+void* mm_realloc(void* ptr, size_t size)
+{
+    buddy_t* block;
+    buddy_t* buddy;
+    void* newp;
+    int order;
+    int current;
+
+    if (ptr == NULL)
+    {
+        return mm_malloc(size);
+    }
+
+    if (size == 0)
+    {
+        mm_free(ptr);
+
+        return NULL;
+    }
+
+    if ((order = orderOf(size)) < 0)
+    {
+        return NULL;
+    }
+
+    block = payloadToBlock(ptr);
+    current = block->order;
+
+    if (order <= current)
+    {
+        return ptr;
+    }
+
+    /* Only worth starting if every buddy up to the wanted order is free, otherwise the block has to move anyway */
+    for (int k = current; k < order; k++)
+    {
+        buddy = buddyOf(block, k);
+
+        if (buddy == NULL || buddy < block || buddy->allocated || buddy->order != k)
+        {
+            break;
+        }
+
+        if (k + 1 == order)
+        {
+            for (k = current; k < order; k++)
+            {
+                removeBlock(buddyOf(block, k));
+            }
+
+            block->order = order;
+
+            return ptr;
+        }
+    }
+
+    if ((newp = mm_malloc(size)) == NULL)
+    {
+        return NULL;
+    }
+
+    memcpy(newp, ptr, BLOCK_SIZE(current) - sizeof(size_t));
+    mm_free(ptr);
+
+    return newp;
+} /* $end mm_realloc */
+
+/*
+ * mm_get_stats - Report the mem_sbrk calls of the arena and the bytes they added, which is all of the arena
+ */
+/* $begin mm_get_stats */
+void mm_get_stats(mm_stats_t* stats)
+{
+    stats->extensions = arenaGrowths;
+    stats->extendedBytes = arenaSize;
+    stats->heapBytes = arenaSize;
+} /* $end mm_get_stats */
+
+/*
+ * mm_profile_load - The arena grows in whole orders on demand, there is nothing to pre-warm, only clearing is accepted
+ */
+/* $begin mm_profile_load */
+int mm_profile_load(const char* path)
+{
+    return path == NULL ? 0 : -1;
+} /* $end mm_profile_load */
+
+/*
+ * mm_profile_save - No profiles without mm_profile_load
+ */
+/* $begin mm_profile_save */
+int mm_profile_save(const char* path)
+{
+    return -1;
+} /* $end mm_profile_save */
+
+/*
+ * mm_trim - The arena only ever grows, there is nothing to hand back
+ */
+/* $begin mm_trim */
+int mm_trim(size_t pad)
+{
+    (void)pad;
+
+    return 0;
+} /* $end mm_trim */
+
+/*
+ * mm_maint_start - There is no deferred work to do in the background
+ */
+/* $begin mm_maint_start */
+int mm_maint_start(unsigned int intervalMs)
+{
+    (void)intervalMs;
+
+    return -1;
+} /* $end mm_maint_start */
+
+/*
+ * mm_maint_stop - Nothing to stop
+ */
+/* $begin mm_maint_stop */
+void mm_maint_stop(void)
+{
+} /* $end mm_maint_stop */
+
+/*
+ * mm_region_create - Regions are not part of the buddy backend
+ */
+/* $begin mm_region_create */
+mm_region_t* mm_region_create(mm_heap_t* heap)
+{
+    (void)heap;
+
+    return NULL;
+} /* $end mm_region_create */
+
+/* The rest of the region interface only exists so mdriver links, mm_region_create never hands out a region */
+void* mm_region_alloc(mm_region_t* region, size_t size)
+{
+    (void)region;
+    (void)size;
+
+    return NULL;
+}
+
+mm_region_mark_t mm_region_mark(mm_region_t* region)
+{
+    mm_region_mark_t mark = {NULL, NULL};
+
+    (void)region;
+
+    return mark;
+}
+
+void mm_region_release(mm_region_t* region, mm_region_mark_t mark)
+{
+    (void)region;
+    (void)mark;
+}
+
+void mm_region_destroy(mm_region_t* region)
+{
+    (void)region;
+}
+
+/*
+ * orderOf - The order of the smallest block that holds size bytes and the header, -1 if there is none
+ */
+/* $begin orderOf */
+static int orderOf(size_t size)
+{
+    int order;
+
+    if (size > BLOCK_SIZE(MAX_ORDER) - sizeof(size_t))
+    {
+        return -1;
+    }
+
+    size += sizeof(size_t);
+    order = 64 - __builtin_clzl(size - 1);
+
+    return order < MIN_ORDER ? MIN_ORDER : order;
+} /* $end orderOf */
+
+/*
+ * payloadToBlock - The header in front of a payload
+ */
+/* $begin payloadToBlock */
+static buddy_t* payloadToBlock(void* payload)
+{
+    return (buddy_t*)((char*)payload - sizeof(size_t));
+} /* $end payloadToBlock */
+
+/*
+ * buddyOf - The buddy of a block of the given order, NULL if it lies past the top of the arena
+ */
+/* $begin buddyOf */
+static buddy_t* buddyOf(buddy_t* block, int order)
+{
+    size_t offset = ((char*)block - arenaStart) ^ BLOCK_SIZE(order);
+
+    if (order >= MAX_ORDER || offset + BLOCK_SIZE(order) > arenaSize)
+    {
+        return NULL;
+    }
+
+    return (buddy_t*)(arenaStart + offset);
+} /* $end buddyOf */
+
+/*
+ * insertBlock - Push a free block of the given order onto its list
+ */
+/* $begin insertBlock */
+static void insertBlock(buddy_t* block, int order)
+{
+    block->allocated = false;
+    block->order = order;
+    block->prev = NULL;
+    block->next = freeLists[order];
+
+    if (freeLists[order] != NULL)
+    {
+        freeLists[order]->prev = block;
+    }
+
+    freeLists[order] = block;
+    nonEmpty |= (uint64_t)1 << order;
+} /* $end insertBlock */
+
+/*
+ * removeBlock - Unlink a free block from the list of its order
+ */
+/* $begin removeBlock */
+static void removeBlock(buddy_t* block)
+{
+    int order = block->order;
+
+    if (block->prev != NULL)
+    {
+        block->prev->next = block->next;
+    }
+    else
+    {
+        freeLists[order] = block->next;
+    }
+
+    if (block->next != NULL)
+    {
+        block->next->prev = block->prev;
+    }
+
+    if (freeLists[order] == NULL)
+    {
+        nonEmpty &= ~((uint64_t)1 << order);
+    }
+} /* $end removeBlock */
+
+/*
+ * splitBlock - Halve a block of the given order down to want, freeing every upper half
+ */
+/* $begin splitBlock */
+static buddy_t* splitBlock(buddy_t* block, int order, int want)
+{
+    while (order > want)
+    {
+        order--;
+        insertBlock((buddy_t*)((char*)block + BLOCK_SIZE(order)), order);
+    }
+
+    block->order = want;
+
+    return block;
+} /* $end splitBlock */
+
+/*
+ * mergeBlock - Free a block, merging it with its buddy as long as the buddy is free and whole
+ */
+/* $begin mergeBlock */
+static void mergeBlock(buddy_t* block)
+{
+    int order = block->order;
+    buddy_t* buddy;
+
+    while ((buddy = buddyOf(block, order)) != NULL && !buddy->allocated && buddy->order == order)
+    {
+        removeBlock(buddy);
+
+        if (buddy < block)
+        {
+            block = buddy;
+        }
+
+        order++;
+    }
+
+    insertBlock(block, order);
+} /* $end mergeBlock */
+
+/*
+ * growArena - Extend the arena by one block of the given order, first filling any gap below its alignment
+ *     with free blocks
+ */
+/* $begin growArena */
+static buddy_t* growArena(int order)
+{
+    buddy_t* block;
+    int gap;
+
+    while ((arenaSize & (BLOCK_SIZE(order) - 1)) != 0)
+    {
+        gap = __builtin_ctzl(arenaSize);
+
+        if ((block = mem_sbrk(BLOCK_SIZE(gap))) == (void*)-1)
+        {
+            return NULL;
+        }
+
+        arenaSize += BLOCK_SIZE(gap);
+        arenaGrowths++;
+        block->order = gap;
+        mergeBlock(block);
+    }
+
+    if ((block = mem_sbrk(BLOCK_SIZE(order))) == (void*)-1)
+    {
+        return NULL;
+    }
+
+    arenaSize += BLOCK_SIZE(order);
+    arenaGrowths++;
+    block->order = order;
+
+    return block;
+} /* $end growArena */
+
+/*
+ * mm_checkheap - Walk the arena block by block, then make sure every list holds only free blocks of its order
+ */
+/* $begin mm_checkheap */
+void mm_checkheap(int verbose)
+{
+    size_t offset = 0;
+    buddy_t* block;
+
+    while (offset < arenaSize)
+    {
+        block = (buddy_t*)(arenaStart + offset);
+
+        if (verbose)
+        {
+            printf("%p: order %d, %s\n", (void*)block, (int)block->order, block->allocated ? "allocated" : "free");
+        }
+
+        if ((offset & (BLOCK_SIZE(block->order) - 1)) != 0)
+        {
+            printf("Error: %p is not aligned to its order %d\n", (void*)block, (int)block->order);
+        }
+
+        if (!block->allocated && buddyOf(block, block->order) != NULL && !buddyOf(block, block->order)->allocated
+            && buddyOf(block, block->order)->order == block->order)
+        {
+            printf("Error: %p and its buddy are both free\n", (void*)block);
+        }
+
+        offset += BLOCK_SIZE(block->order);
+    }
+
+    if (offset != arenaSize)
+    {
+        printf("Error: blocks run past the top of the arena\n");
+    }
+
+    for (int order = 0; order < ORDERS; order++)
+    {
+        if ((freeLists[order] != NULL) != ((nonEmpty >> order) & 1))
+        {
+            printf("Error: bitmap out of date for order %d\n", order);
+        }
+
+        for (block = freeLists[order]; block != NULL; block = block->next)
+        {
+            if (block->allocated || block->order != order)
+            {
+                printf("Error: %p on the list of order %d\n", (void*)block, order);
+            }
+        }
+    }
+} /* $end mm_checkheap */
@@ -0,0 +1,172 @@
+/*
+ * mmcolor.c - Traversal benchmark for slab coloring in object caches
+ *
+ * For each object stride, allocates -n nodes, deals them out round robin
+ * to -l linked lists and then walks every list -p times, touching the
+ * first cache line of each node. Consecutive nodes of a list are l
+ * strides apart, so with a power of 2 stride they map to the same few
+ * cache sets of a slab, and only the slab colors can spread them out.
+ * Runs each stride with plain mm_malloc nodes, with an object cache and
+ * with an object cache on a heap built with MM_CONF color:1, and reports
+ * the ns per visited node of the best of -r runs.
+ *
+ * usage: mmcolor [-n <nodes>] [-l <lists>] [-p <passes>] [-r <runs>]
+ */
+#include "memlib.h"
+#include "mm.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+/* The part of a node the traversal touches */
+typedef struct node {
+    struct node *next;
+    long key;
+} node_t;
+
+static long nodes = 8192;   /* nodes per run (-n) */
+static int lists = 8;       /* lists the nodes are dealt out to (-l) */
+static int passes = 50;     /* walks of every list per run (-p) */
+static long sink;           /* keeps the sums of the walks alive */
+
+static double best_run(size_t stride, int kind, int runs);
+static double traverse(node_t **heads);
+static double now(void);
+static void check(int ok, char *msg);
+
+int main(int argc, char **argv) {
+    static const size_t strides[] = {128, 256, 512, 1024, 2048, 4096};
+    int runs = 5;           /* runs of each stride and kind (-r) */
+    size_t i;
+    int c;
+
+    while ((c = getopt(argc, argv, "n:l:p:r:h")) != EOF) {
+        switch (c) {
+        case 'n':
+            nodes = strtol(optarg, NULL, 0);
+            break;
+        case 'l':
+            lists = atoi(optarg);
+            break;
+        case 'p':
+            passes = atoi(optarg);
+            break;
+        case 'r':
+            runs = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: mmcolor [-n <nodes>] [-l <lists>] [-p <passes>] [-r <runs>]\n");
+            exit(c == 'h' ? 0 : 1);
+        }
+    }
+    if (nodes < 1 || lists < 1 || passes < 1 || runs < 1) {
+        fprintf(stderr, "usage: mmcolor [-n <nodes>] [-l <lists>] [-p <passes>] [-r <runs>]\n");
+        exit(1);
+    }
+
+    mem_init();
+
+    printf("%d nodes in %d lists, ns per node visited\n", (int)nodes, lists);
+    printf("%8s %10s %10s %10s %8s\n", "stride", "mm_malloc", "cache", "colored", "speedup");
+    for (i = 0; i < sizeof(strides) / sizeof(strides[0]); i++) {
+        double plain = best_run(strides[i], 0, runs);
+        double cache = best_run(strides[i], 1, runs);
+        double colored = best_run(strides[i], 2, runs);
+
+        printf("%8zu %10.2f %10.2f %10.2f %7.2fx\n", strides[i], plain, cache,
+               colored, cache / colored);
+    }
+
+    mem_deinit();
+    return sink == 42 ? 1 : 0;
+}
+
+/*
+ * best_run - build and walk the lists runs times with nodes of stride
+ *    bytes from mm_malloc (kind 0), an object cache (1) or an object cache
+ *    with colored slabs (2), and return the best ns per node visited
+ */
+static double best_run(size_t stride, int kind, int runs) {
+    node_t **heads, **tails;
+    mm_cache_t *cache = NULL;
+    double best = 0, ns;
+    long i;
+    int r;
+
+    check((heads = calloc(lists, sizeof(node_t *))) != NULL, "calloc failed");
+    check((tails = calloc(lists, sizeof(node_t *))) != NULL, "calloc failed");
+
+    for (r = 0; r < runs; r++) {
+        /* A fresh heap for every run, so each one starts from the same addresses */
+        check(mm_configure(kind == 2 ? "color:1" : "color:0") == 0, "mm_configure failed");
+        mem_reset_brk();
+        check(mm_init() == 0, "mm_init failed");
+
+        /* The link word of the cache and the boundary tags of mm_malloc both fit in the stride */
+        if (kind > 0)
+            check((cache = mm_cache_create(stride - sizeof(void *), 64, NULL, NULL)) != NULL,
+                  "mm_cache_create failed");
+
+        for (i = 0; i < lists; i++)
+            heads[i] = tails[i] = NULL;
+        for (i = 0; i < nodes; i++) {
+            node_t *n = kind > 0 ? mm_cache_alloc(cache) : mm_malloc(stride - 16);
+
+            check(n != NULL, "allocation failed");
+            n->next = NULL;
+            n->key = i;
+            if (tails[i % lists] == NULL)
+                heads[i % lists] = n;
+            else
+                tails[i % lists]->next = n;
+            tails[i % lists] = n;
+        }
+
+        ns = traverse(heads);
+        if (r == 0 || ns < best)
+            best = ns;
+
+        if (kind > 0)
+            mm_cache_destroy(cache);
+    }
+
+    free(heads);
+    free(tails);
+    return best;
+}
+
+/*
+ * traverse - walk every list passes times, returning ns per node visited
+ */
+static double traverse(node_t **heads) {
+    double start = now();
+    node_t *n;
+    int p, l;
+
+    for (p = 0; p < passes; p++)
+        for (l = 0; l < lists; l++)
+            for (n = heads[l]; n != NULL; n = n->next)
+                sink += n->key;
+    return (now() - start) * 1e9 / ((double)nodes * passes);
+}
+
+/*
+ * now - wall clock time in seconds
+ */
+static double now(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+/*
+ * check - exit with msg unless ok
+ */
+static void check(int ok, char *msg) {
+    if (!ok) {
+        fprintf(stderr, "mmcolor: %s\n", msg);
+        exit(1);
+    }
+}
@@ -0,0 +1,196 @@
+/*
+ * mmepoch.c - Benchmark for epoch-based reclamation with mm_retire
+ *
+ * A table of -s slots points at small nodes. -t reader threads look up
+ * random slots without a lock, each lookup inside mm_epoch_enter and
+ * mm_epoch_exit, while one writer replaces -n nodes, one slot at a time,
+ * and hands every replaced node to mm_retire. The writer is the only
+ * thread that allocates or frees, as mm.c itself is not thread-safe.
+ *
+ * A freed node has its first word overwritten by the free list link, and
+ * is soon handed out again for another slot, so a reader that finds a
+ * node without its magic number, or with the value of another slot once
+ * it is done with it, read freed memory. The same run with mm_free in
+ * place of mm_retire shows how often that happens without the epochs. Reports the replacements and lookups per
+ * second of both, the stale reads, and the heap size after each run.
+ *
+ * usage: mmepoch [-t <readers>] [-n <replacements>] [-s <slots>]
+ */
+#include "memlib.h"
+#include "mm.h"
+#include <getopt.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#define MAGIC 0x6d6d65706f6368ULL /* first word of every live node */
+
+/*
+ * A table entry, the magic sits where mm_free puts the free list link.
+ * The padding keeps it above mm.c's small request threshold, below which
+ * every request grows the heap instead of reusing freed blocks.
+ */
+typedef struct {
+    uint64_t magic;
+    uint64_t value;
+    char pad[112];
+} node_t;
+
+static node_t **slots;          /* the table the readers search, slot i holds a value of i mod slots */
+static long num_slots = 4096;   /* slots of the table (-s) */
+static int stop;                /* set once the writer is done */
+
+/* What a reader thread counted */
+typedef struct {
+    unsigned seed;
+    long lookups;
+    long stale;
+} reader_t;
+
+static void run(int readers, long replacements, int retire);
+static void *lookup(void *arg);
+static double now(void);
+static void check(int ok, char *msg);
+
+int main(int argc, char **argv) {
+    int readers = 4;                /* reader threads (-t) */
+    long replacements = 2000000;    /* nodes the writer replaces (-n) */
+    int c;
+
+    while ((c = getopt(argc, argv, "t:n:s:h")) != EOF) {
+        switch (c) {
+        case 't':
+            readers = atoi(optarg);
+            break;
+        case 'n':
+            replacements = strtol(optarg, NULL, 0);
+            break;
+        case 's':
+            num_slots = strtol(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: mmepoch [-t <readers>] [-n <replacements>] [-s <slots>]\n");
+            exit(c == 'h' ? 0 : 1);
+        }
+    }
+    if (readers < 1 || replacements < 1 || num_slots < 1) {
+        fprintf(stderr, "usage: mmepoch [-t <readers>] [-n <replacements>] [-s <slots>]\n");
+        exit(1);
+    }
+
+    mem_init();
+    check((slots = calloc(num_slots, sizeof(node_t *))) != NULL, "calloc failed");
+
+    printf("%d readers, %ld slots\n", readers, num_slots);
+    printf("%10s %14s %14s %12s %10s\n", "free with", "replaces/s", "lookups/s", "stale reads", "heap");
+    run(readers, replacements, 1);
+    run(readers, replacements, 0);
+
+    free(slots);
+    mem_deinit();
+    return 0;
+}
+
+/*
+ * run - let the writer replace nodes while the readers look them up,
+ *    handing old nodes to mm_retire if retire or else straight to mm_free,
+ *    and print what the run achieved
+ */
+static void run(int readers, long replacements, int retire) {
+    pthread_t tids[readers];
+    reader_t counts[readers];
+    long lookups = 0, stale = 0, i;
+    mm_stats_t stats;
+    double start, secs;
+    int r;
+
+    mem_reset_brk();
+    check(mm_init() == 0, "mm_init failed");
+    for (i = 0; i < num_slots; i++) {
+        check((slots[i] = mm_malloc(sizeof(node_t))) != NULL, "mm_malloc failed");
+        slots[i]->magic = MAGIC;
+        slots[i]->value = i;
+    }
+
+    stop = 0;
+    for (r = 0; r < readers; r++) {
+        counts[r].seed = r + 1;
+        check(pthread_create(&tids[r], NULL, lookup, &counts[r]) == 0, "pthread_create failed");
+    }
+
+    start = now();
+    for (i = 0; i < replacements; i++) {
+        node_t *node = mm_malloc(sizeof(node_t));
+        node_t *old;
+
+        check(node != NULL, "mm_malloc failed");
+        node->magic = MAGIC;
+        node->value = i;
+        old = __atomic_exchange_n(&slots[i % num_slots], node, __ATOMIC_ACQ_REL);
+        if (retire)
+            mm_retire(old);
+        else
+            mm_free(old);
+    }
+    secs = now() - start;
+
+    __atomic_store_n(&stop, 1, __ATOMIC_RELEASE);
+    for (r = 0; r < readers; r++) {
+        pthread_join(tids[r], NULL);
+        lookups += counts[r].lookups;
+        stale += counts[r].stale;
+    }
+
+    mm_get_stats(&stats);
+    printf("%10s %13.2fM %13.2fM %12ld %9zuk\n", retire ? "mm_retire" : "mm_free",
+           replacements / secs / 1e6, lookups / secs / 1e6, stale, stats.heapBytes / 1024);
+}
+
+/*
+ * lookup - reader thread body, reads random slots in critical sections
+ *    until the writer stops, checking each node once it has read all of it
+ */
+static void *lookup(void *arg) {
+    reader_t *reader = arg;
+    uint64_t sum = 0;
+    int i;
+
+    reader->lookups = reader->stale = 0;
+    while (!__atomic_load_n(&stop, __ATOMIC_ACQUIRE)) {
+        long slot = rand_r(&reader->seed) % num_slots;
+        node_t *node;
+
+        check(mm_epoch_enter() == 0, "mm_epoch_enter failed");
+        node = __atomic_load_n(&slots[slot], __ATOMIC_ACQUIRE);
+        for (i = 0; i < (int)sizeof(node->pad); i++)
+            sum += __atomic_load_n(&node->pad[i], __ATOMIC_RELAXED);
+        if (__atomic_load_n(&node->magic, __ATOMIC_RELAXED) != MAGIC ||
+            __atomic_load_n(&node->value, __ATOMIC_RELAXED) % num_slots != (uint64_t)slot)
+            reader->stale++;
+        mm_epoch_exit();
+        reader->lookups++;
+    }
+    return sum == 42 ? arg : NULL;
+}
+
+/*
+ * now - wall clock time in seconds
+ */
+static double now(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+/*
+ * check - exit with msg unless ok
+ */
+static void check(int ok, char *msg) {
+    if (!ok) {
+        fprintf(stderr, "mmepoch: %s\n", msg);
+        exit(1);
+    }
+}
@@ -0,0 +1,209 @@
+/*
+ * mmguard.c - Benchmark and demonstration of guarded sampling (MM_CONF guard)
+ *
+ * First makes -n mm_malloc and mm_free calls on a table of -s slots,
+ * each time freeing the block of a random slot and allocating one of
+ * 16 to 1024 bytes in its place, once without sampling and once with
+ * MM_CONF guard:<rate> (-r). Reports the calls per second of both and how
+ * much slower the sampled run was.
+ *
+ * Then makes each bug the guarded pool catches in a child process that
+ * samples every allocation (guard:1): an overflow, an underflow, a
+ * use-after-free and a double free. The child's report goes to stderr and
+ * the parent prints how the child ended, SIGSEGV from a guard page or a
+ * protected page, SIGABRT from a check in mm_free. A block is pushed
+ * against one side of its page at random, so an overflow or underflow
+ * away from that side stays within the page and is only caught by the
+ * free.
+ *
+ * usage: mmguard [-r <rate>] [-n <calls>] [-s <slots>]
+ */
+#include "memlib.h"
+#include "mm.h"
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static long calls = 20000000;   /* mm_malloc and mm_free calls (-n) */
+static long num_slots = 4096;   /* slots of the table (-s) */
+
+static double run(const char *conf);
+static void overflow(void);
+static void underflow(void);
+static void use_after_free(void);
+static void double_free(void);
+static void provoke(const char *name, void (*bug)(void));
+static double now(void);
+static void check(int ok, char *msg);
+
+int main(int argc, char **argv) {
+    long rate = 1000;   /* sampling rate of the guarded run (-r) */
+    char conf[32];
+    double plain, guarded;
+    int c;
+
+    while ((c = getopt(argc, argv, "r:n:s:h")) != EOF) {
+        switch (c) {
+        case 'r':
+            rate = strtol(optarg, NULL, 0);
+            break;
+        case 'n':
+            calls = strtol(optarg, NULL, 0);
+            break;
+        case 's':
+            num_slots = strtol(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: mmguard [-r <rate>] [-n <calls>] [-s <slots>]\n");
+            exit(c == 'h' ? 0 : 1);
+        }
+    }
+    if (rate < 1 || calls < 2 || num_slots < 1) {
+        fprintf(stderr, "usage: mmguard [-r <rate>] [-n <calls>] [-s <slots>]\n");
+        exit(1);
+    }
+
+    mem_init();
+
+    snprintf(conf, sizeof(conf), "guard:%ld", rate);
+    plain = run("guard:0");
+    guarded = run(conf);
+    printf("%14s %14s %14s\n", "guard:0", conf, "slowdown");
+    printf("%12.2fM/s %12.2fM/s %13.1f%%\n\n", plain / 1e6, guarded / 1e6, (plain / guarded - 1) * 100);
+    fflush(stdout);
+
+    provoke("overflow", overflow);
+    provoke("underflow", underflow);
+    provoke("use-after-free", use_after_free);
+    provoke("double free", double_free);
+
+    mem_deinit();
+    return 0;
+}
+
+/*
+ * run - churn the table with the heap configured by conf, returning the
+ *    mm_malloc and mm_free calls per second
+ */
+static double run(const char *conf) {
+    char **table;
+    unsigned seed = 1;
+    double start, secs;
+    long i;
+
+    check(mm_configure(conf) == 0, "mm_configure failed");
+    mem_reset_brk();
+    check(mm_init() == 0, "mm_init failed");
+    check((table = calloc(num_slots, sizeof(char *))) != NULL, "calloc failed");
+
+    start = now();
+    for (i = 0; i < calls / 2; i++) {
+        long slot = rand_r(&seed) % num_slots;
+        size_t size = 16 + rand_r(&seed) % 1009;
+
+        if (table[slot] != NULL)
+            mm_free(table[slot]);
+        check((table[slot] = mm_malloc(size)) != NULL, "mm_malloc failed");
+        table[slot][0] = table[slot][size - 1] = 1;
+    }
+    secs = now() - start;
+
+    for (i = 0; i < num_slots; i++)
+        if (table[i] != NULL)
+            mm_free(table[i]);
+    free(table);
+    mm_configure(NULL);
+    return calls / secs;
+}
+
+/*
+ * overflow - write 64 bytes past the end of a block, then free it
+ */
+static void overflow(void) {
+    volatile char *p = mm_malloc(100);
+    int i;
+
+    for (i = 0; i < 100 + 64; i++)
+        p[i] = 0;
+    mm_free((char *)p);
+}
+
+/*
+ * underflow - write the byte before a block, then free it
+ */
+static void underflow(void) {
+    volatile char *p = mm_malloc(100);
+
+    p[-1] = 0;
+    mm_free((char *)p);
+}
+
+/*
+ * use_after_free - write to a block after freeing it
+ */
+static void use_after_free(void) {
+    volatile char *p = mm_malloc(100);
+
+    mm_free((char *)p);
+    p[0] = 0;
+}
+
+/*
+ * double_free - free a block twice
+ */
+static void double_free(void) {
+    char *p = mm_malloc(100);
+
+    mm_free(p);
+    mm_free(p);
+}
+
+/*
+ * provoke - run bug in a child that guards every allocation and print
+ *    how the child ended
+ */
+static void provoke(const char *name, void (*bug)(void)) {
+    pid_t pid;
+    int status;
+
+    check((pid = fork()) >= 0, "fork failed");
+    if (pid == 0) {
+        check(mm_configure("guard:1") == 0, "mm_configure failed");
+        mem_reset_brk();
+        check(mm_init() == 0, "mm_init failed");
+        bug();
+        _exit(0);
+    }
+
+    check(waitpid(pid, &status, 0) == pid, "waitpid failed");
+    if (WIFSIGNALED(status))
+        printf("%-16s caught, %s\n\n", name, strsignal(WTERMSIG(status)));
+    else
+        printf("%-16s missed\n\n", name);
+    fflush(stdout);
+}
+
+/*
+ * now - wall clock time in seconds
+ */
+static double now(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+/*
+ * check - exit with msg unless ok
+ */
+static void check(int ok, char *msg) {
+    if (!ok) {
+        fprintf(stderr, "mmguard: %s\n", msg);
+        exit(1);
+    }
+}
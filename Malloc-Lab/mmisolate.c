@@ -0,0 +1,137 @@
+/*
+ * mmisolate.c - False sharing benchmark for mm_malloc_isolated
+ *
+ * Gives each of 1, 2, 4, ... -t threads a counter of its own and lets
+ * every thread increment its counter -n times. The counters come either
+ * from back to back mm_malloc calls, which pack several of them into one
+ * cache line, or from mm_malloc_isolated, which gives each its own line.
+ * Reports the total increments per second of both and their ratio, on
+ * a machine with fewer cores than threads the threads take turns and the
+ * two stay close.
+ *
+ * usage: mmisolate [-t <max threads>] [-n <increments per thread>]
+ */
+#include "memlib.h"
+#include "mm.h"
+#include <getopt.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+static long increments = 50000000;  /* increments per thread (-n) */
+
+static double run(int threads, int isolated, int *shared_lines);
+static void *count(void *counter);
+static double now(void);
+static void check(int ok, char *msg);
+
+int main(int argc, char **argv) {
+    int max_threads = 8;    /* most threads to run (-t) */
+    int threads, shared_lines;
+    double packed, isolated;
+    int c;
+
+    while ((c = getopt(argc, argv, "t:n:h")) != EOF) {
+        switch (c) {
+        case 't':
+            max_threads = atoi(optarg);
+            break;
+        case 'n':
+            increments = strtol(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: mmisolate [-t <max threads>] [-n <increments per thread>]\n");
+            exit(c == 'h' ? 0 : 1);
+        }
+    }
+    if (max_threads < 1 || increments < 1) {
+        fprintf(stderr, "usage: mmisolate [-t <max threads>] [-n <increments per thread>]\n");
+        exit(1);
+    }
+
+    mem_init();
+    check(mm_init() == 0, "mm_init failed");
+
+    printf("%8s %14s %12s %14s %8s\n", "threads", "shared lines", "mm_malloc", "isolated", "speedup");
+    for (threads = 1; threads <= max_threads; threads *= 2) {
+        packed = run(threads, 0, &shared_lines);
+        isolated = run(threads, 1, NULL);
+        printf("%8d %14d %8.0fM/s %10.0fM/s %7.2fx\n", threads, shared_lines,
+               packed / 1e6, isolated / 1e6, isolated / packed);
+    }
+
+    mem_deinit();
+    return 0;
+}
+
+/*
+ * run - let threads threads increment counters from mm_malloc or
+ *    mm_malloc_isolated, returning the total increments per second and,
+ *    if shared_lines is not NULL, how many counters share a line with
+ *    the counter before them
+ */
+static double run(int threads, int isolated, int *shared_lines) {
+    pthread_t tids[threads];
+    long *counters[threads];
+    double start, secs;
+    int i;
+
+    for (i = 0; i < threads; i++) {
+        counters[i] = isolated ? mm_malloc_isolated(sizeof(long)) : mm_malloc(sizeof(long));
+        check(counters[i] != NULL, "allocation failed");
+        *counters[i] = 0;
+    }
+    if (shared_lines != NULL)
+        for (*shared_lines = 0, i = 1; i < threads; i++)
+            *shared_lines += (uintptr_t)counters[i] / 64 == (uintptr_t)counters[i - 1] / 64;
+
+    start = now();
+    for (i = 0; i < threads; i++)
+        check(pthread_create(&tids[i], NULL, count, counters[i]) == 0, "pthread_create failed");
+    for (i = 0; i < threads; i++)
+        pthread_join(tids[i], NULL);
+    secs = now() - start;
+
+    for (i = 0; i < threads; i++) {
+        check(*counters[i] == increments, "lost an increment");
+        if (isolated)
+            mm_free_isolated(counters[i]);
+        else
+            mm_free(counters[i]);
+    }
+    return threads * increments / secs;
+}
+
+/*
+ * count - thread body, increments its counter through memory each time
+ */
+static void *count(void *counter) {
+    volatile long *c = counter;
+    long i;
+
+    for (i = 0; i < increments; i++)
+        (*c)++;
+    return NULL;
+}
+
+/*
+ * now - wall clock time in seconds
+ */
+static double now(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+/*
+ * check - exit with msg unless ok
+ */
+static void check(int ok, char *msg) {
+    if (!ok) {
+        fprintf(stderr, "mmisolate: %s\n", msg);
+        exit(1);
+    }
+}
@@ -0,0 +1,159 @@
+/*
+ * mmpmr.cpp - Benchmark of std::pmr containers on mm
+ *
+ * Runs vector, map, unordered_map and string workloads on std::pmr
+ * containers backed by mm::resource (the default mm heap), by
+ * std::pmr::new_delete_resource (glibc through new and delete) and by a
+ * std::pmr::monotonic_buffer_resource over new and delete. Each round
+ * builds and tears down its containers, and the monotonic resource is
+ * released after every round. Reports the best round of each in ms.
+ *
+ * usage: mmpmr [-n <rounds>] [-s <elements>]
+ */
+#include "memlib.h"
+#include "mm.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <getopt.h>
+#include <map>
+#include <memory_resource>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+static long elements = 100000;  /* elements per workload (-s) */
+static long sink;               /* keeps the results of a round alive */
+
+static void vectors(std::pmr::memory_resource *res);
+static void maps(std::pmr::memory_resource *res);
+static void unordered_maps(std::pmr::memory_resource *res);
+static void strings(std::pmr::memory_resource *res);
+static double best_round(void (*workload)(std::pmr::memory_resource *),
+                         int kind, int rounds);
+
+int main(int argc, char **argv) {
+    static const struct {
+        const char *name;
+        void (*run)(std::pmr::memory_resource *);
+    } workloads[] = {
+        {"vector", vectors},
+        {"map", maps},
+        {"unordered_map", unordered_maps},
+        {"string", strings},
+    };
+    int rounds = 5;             /* rounds of each workload (-n) */
+    int c;
+
+    while ((c = getopt(argc, argv, "n:s:h")) != EOF) {
+        switch (c) {
+        case 'n':
+            rounds = atoi(optarg);
+            break;
+        case 's':
+            elements = strtol(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: mmpmr [-n <rounds>] [-s <elements>]\n");
+            exit(c == 'h' ? 0 : 1);
+        }
+    }
+
+    mem_init();
+    if (mm_init() < 0) {
+        fprintf(stderr, "mmpmr: mm_init failed\n");
+        exit(1);
+    }
+
+    printf("%14s %10s %10s %10s\n", "workload", "mm", "new/delete", "monotonic");
+    for (const auto &w : workloads)
+        printf("%14s %8.2fms %8.2fms %8.2fms\n", w.name,
+               best_round(w.run, 0, rounds), best_round(w.run, 1, rounds),
+               best_round(w.run, 2, rounds));
+
+    mem_deinit();
+    return sink == 42 ? 1 : 0;
+}
+
+/*
+ * best_round - time rounds runs of workload on the resource of kind
+ *    (0 mm, 1 new/delete, 2 monotonic) and return the best in ms
+ */
+static double best_round(void (*workload)(std::pmr::memory_resource *),
+                         int kind, int rounds) {
+    mm::resource mm_res;
+    std::pmr::monotonic_buffer_resource monotonic(std::pmr::new_delete_resource());
+    std::pmr::memory_resource *res = kind == 0 ? (std::pmr::memory_resource *)&mm_res
+                                   : kind == 1 ? std::pmr::new_delete_resource()
+                                   : &monotonic;
+    double best = 0;
+
+    for (int i = 0; i < rounds; i++) {
+        auto start = std::chrono::steady_clock::now();
+        workload(res);
+        monotonic.release();
+        std::chrono::duration<double, std::milli> ms =
+            std::chrono::steady_clock::now() - start;
+        if (i == 0 || ms.count() < best)
+            best = ms.count();
+    }
+    return best;
+}
+
+/*
+ * vectors - many short vectors grown one push_back at a time
+ */
+static void vectors(std::pmr::memory_resource *res) {
+    std::pmr::vector<std::pmr::vector<int>> outer(res);
+
+    for (long i = 0; i < elements / 100; i++) {
+        outer.emplace_back();
+        for (int j = 0; j < 100; j++)
+            outer.back().push_back(j);
+    }
+    sink += outer.size();
+}
+
+/*
+ * maps - random inserts into an ordered map, then erase half of it
+ */
+static void maps(std::pmr::memory_resource *res) {
+    std::pmr::map<long, long> m(res);
+    unsigned long x = 1;
+
+    for (long i = 0; i < elements; i++) {
+        x = x * 6364136223846793005UL + 1442695040888963407UL;
+        m[x >> 20] = i;
+    }
+    for (auto it = m.begin(); it != m.end(); )
+        it = (it->second & 1) ? m.erase(it) : std::next(it);
+    sink += m.size();
+}
+
+/*
+ * unordered_maps - inserts into a hash map, then look every key up
+ */
+static void unordered_maps(std::pmr::memory_resource *res) {
+    std::pmr::unordered_map<long, long> m(res);
+    long found = 0;
+
+    for (long i = 0; i < elements; i++)
+        m.emplace(i * 7919, i);
+    for (long i = 0; i < elements; i++)
+        found += m.count(i * 7919);
+    sink += found;
+}
+
+/*
+ * strings - strings too long for the small string buffer, built by appends
+ */
+static void strings(std::pmr::memory_resource *res) {
+    std::pmr::vector<std::pmr::string> v(res);
+
+    for (long i = 0; i < elements; i++) {
+        v.emplace_back("key-");
+        for (long j = 0; j < 4 + i % 8; j++)
+            v.back() += "0123456789";
+    }
+    sink += v.size();
+}
@@ -0,0 +1,203 @@
+/*
+ * mmpreload.c - The malloc family of the C library on top of mm.c, for
+ *               libmm.so
+ *
+ *    LD_PRELOAD=./libmm.so sort big.txt
+ *
+ * runs any dynamically linked program with mm.c as its allocator and
+ * memlib's mmap-backed areas as its memory. mm.c is not thread-safe, so
+ * every call goes through one lock. The first call, which may come from
+ * the dynamic loader long before main, sets memlib and mm up. Around a
+ * fork the lock is held, so the child never inherits a heap in the middle
+ * of an update.
+ *
+ * libmm.so is built with MM_ALIGNMENT 16, the alignment callers of the
+ * system malloc rely on. malloc and calloc pass their caller to
+ * mm_malloc_site, so with MM_CONF=predict:1 the program's own allocation
+ * sites predict lifetimes, not this file.
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "memlib.h"
+#include "mm.h"
+
+static pthread_mutex_t mm_lock = PTHREAD_MUTEX_INITIALIZER;
+static int mm_ready;             /* memlib and mm are set up */
+
+static void mm_enter(void);
+static void mm_leave(void);
+static void *mm_aligned(size_t alignment, size_t size);
+static void mm_prepare_fork(void);
+
+/*
+ * mm_register_fork - hold the lock across fork. Runs as a constructor
+ *    rather than from the first malloc: pthread_atfork may allocate.
+ */
+__attribute__((constructor))
+static void mm_register_fork(void)
+{
+    pthread_atfork(mm_prepare_fork, mm_leave, mm_leave);
+}
+
+void *malloc(size_t size)
+{
+    void *p;
+
+    mm_enter();
+    p = mm_malloc_site(size ? size : 1, __builtin_return_address(0));
+    mm_leave();
+    if (p == NULL)
+        errno = ENOMEM;
+    return p;
+}
+
+void free(void *ptr)
+{
+    if (ptr == NULL)
+        return;
+    mm_enter();
+    mm_free(ptr);
+    mm_leave();
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    size_t bytes;
+    void *p;
+
+    if (size != 0 && nmemb > SIZE_MAX / size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    bytes = nmemb * size;
+
+    /* not malloc: the compiler would fold malloc and memset into calloc */
+    mm_enter();
+    p = mm_malloc_site(bytes ? bytes : 1, __builtin_return_address(0));
+    mm_leave();
+    if (p == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    memset(p, 0, bytes);
+    return p;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    void *p;
+
+    if (ptr == NULL)
+        return malloc(size);
+    if (size == 0) {
+        free(ptr);
+        return NULL;
+    }
+    mm_enter();
+    p = mm_realloc(ptr, size);
+    mm_leave();
+    if (p == NULL)
+        errno = ENOMEM;
+    return p;
+}
+
+void *reallocarray(void *ptr, size_t nmemb, size_t size)
+{
+    if (size != 0 && nmemb > SIZE_MAX / size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return realloc(ptr, nmemb * size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    void *p;
+
+    if (alignment < sizeof(void *) || (alignment & (alignment - 1)))
+        return EINVAL;
+    if ((p = mm_aligned(alignment, size)) == NULL)
+        return ENOMEM;
+    *memptr = p;
+    return 0;
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    if (alignment & (alignment - 1)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    return mm_aligned(alignment, size);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    return aligned_alloc(alignment, size);
+}
+
+void *valloc(size_t size)
+{
+    return mm_aligned(getpagesize(), size);
+}
+
+void *pvalloc(size_t size)
+{
+    size_t page = getpagesize();
+
+    return mm_aligned(page, (size + page - 1) & ~(page - 1));
+}
+
+size_t malloc_usable_size(void *ptr)
+{
+    return ptr != NULL ? mm_usable_size(ptr) : 0;
+}
+
+/*
+ * mm_aligned - allocate size bytes at a multiple of alignment, setting
+ *    errno on failure
+ */
+static void *mm_aligned(size_t alignment, size_t size)
+{
+    void *p;
+
+    mm_enter();
+    p = mm_memalign(alignment, size ? size : 1);
+    mm_leave();
+    if (p == NULL)
+        errno = ENOMEM;
+    return p;
+}
+
+/*
+ * mm_enter - take the lock, setting memlib and mm up on the first call
+ */
+static void mm_enter(void)
+{
+    pthread_mutex_lock(&mm_lock);
+    if (!mm_ready) {
+        mem_init();
+        mm_init();
+        mm_ready = 1;
+    }
+}
+
+/*
+ * mm_leave - release the lock, also the parent and child side of fork
+ */
+static void mm_leave(void)
+{
+    pthread_mutex_unlock(&mm_lock);
+}
+
+/*
+ * mm_prepare_fork - take the lock before fork
+ */
+static void mm_prepare_fork(void)
+{
+    pthread_mutex_lock(&mm_lock);
+}
@@ -0,0 +1,113 @@
+/*
+ * mmrun.c - Run a program on the system malloc and on libmm.so and
+ *           compare them
+ *
+ * Runs the command given on the command line -n times as is and -n times
+ * with LD_PRELOAD pointing at libmm.so, and reports the best wall clock
+ * time and the largest peak resident set size of each.
+ *
+ * usage: mmrun [-n <runs>] [-l <path to libmm.so>] command [args...]
+ */
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static void run(char **argv, char *preload, int runs, double *secs,
+                long *rss_kb);
+static double now(void);
+
+int main(int argc, char **argv) {
+    char *lib = "./libmm.so";  /* library to preload (-l) */
+    int runs = 3;              /* runs of each allocator (-n) */
+    char path[4096];
+    double glibc_secs, mm_secs;
+    long glibc_rss, mm_rss;
+    int c;
+
+    while ((c = getopt(argc, argv, "+n:l:h")) != EOF) {
+        switch (c) {
+        case 'n':
+            runs = atoi(optarg);
+            break;
+        case 'l':
+            lib = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: mmrun [-n <runs>] [-l <path to libmm.so>] command [args...]\n");
+            exit(c == 'h' ? 0 : 1);
+        }
+    }
+    if (optind == argc || runs < 1) {
+        fprintf(stderr, "usage: mmrun [-n <runs>] [-l <path to libmm.so>] command [args...]\n");
+        exit(1);
+    }
+    if (realpath(lib, path) == NULL) {
+        perror("mmrun: libmm.so");
+        exit(1);
+    }
+
+    run(argv + optind, NULL, runs, &glibc_secs, &glibc_rss);
+    run(argv + optind, path, runs, &mm_secs, &mm_rss);
+
+    printf("%10s %10s %12s\n", "malloc", "secs", "peak RSS");
+    printf("%10s %10.3f %10ldKB\n", "glibc", glibc_secs, glibc_rss);
+    printf("%10s %10.3f %10ldKB\n", "libmm", mm_secs, mm_rss);
+    return 0;
+}
+
+/*
+ * run - run argv runs times, with preload in LD_PRELOAD unless it is
+ *    NULL, and return the best time and the largest peak RSS
+ */
+static void run(char **argv, char *preload, int runs, double *secs,
+                long *rss_kb) {
+    struct rusage usage;
+    double start, elapsed;
+    int i, status;
+    pid_t pid;
+
+    *secs = 0;
+    *rss_kb = 0;
+    for (i = 0; i < runs; i++) {
+        start = now();
+        if ((pid = fork()) == 0) {
+            if (preload != NULL)
+                setenv("LD_PRELOAD", preload, 1);
+            else
+                unsetenv("LD_PRELOAD");
+            execvp(argv[0], argv);
+            perror("mmrun: exec");
+            _exit(127);
+        }
+        if (pid < 0 || wait4(pid, &status, 0, &usage) < 0) {
+            perror("mmrun");
+            exit(1);
+        }
+        elapsed = now() - start;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "mmrun: %s failed%s\n", argv[0],
+                    preload != NULL ? " on libmm.so" : "");
+            exit(1);
+        }
+
+        if (i == 0 || elapsed < *secs)
+            *secs = elapsed;
+        if (usage.ru_maxrss > *rss_kb)
+            *rss_kb = usage.ru_maxrss;
+    }
+}
+
+/*
+ * now - wall clock time in seconds
+ */
+static double now(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
@@ -0,0 +1,173 @@
+/*
+ * mmscale.c - Scaling benchmark for heaps and blocks larger than 2 GB
+ *
+ * Grows the mm heap to several tens of GB of virtual memory with blocks
+ * just under the mapping threshold, timing the allocations as the heap
+ * crosses each power of two, then exercises multi-GB mapped blocks and
+ * mremap growth, and finally frees and trims everything. memlib only
+ * reserves RESERVE of address space, so the resident set stays a small
+ * fraction of the heap: each block only touches its boundary tags.
+ *
+ * usage: mmscale [-g <GB>] [-b <block bytes>]
+ */
+#include "config.h"
+#include "memlib.h"
+#include "mm.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define GB ((size_t)1 << 30)
+#define RESERVE (64 * GB)  /* address space of the default area, well past MAX_HEAP */
+
+static double now(void);
+static long peak_rss_kb(void);
+static void check(int ok, char *msg);
+
+int main(int argc, char **argv) {
+    size_t target = 24 * GB;   /* heap size to grow to (-g) */
+    size_t block = 96 * 1024;  /* payload size of each heap block (-b) */
+    size_t nblocks, i, next_mark, mark_blocks;
+    char **blocks;
+    double start, mark_start;
+    char c;
+
+    while ((c = getopt(argc, argv, "g:b:h")) != EOF) {
+        switch (c) {
+        case 'g':
+            target = strtoull(optarg, NULL, 0) * GB;
+            break;
+        case 'b':
+            block = strtoull(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: mmscale [-g <GB>] [-b <block bytes>]\n");
+            exit(c == 'h' ? 0 : 1);
+        }
+    }
+    if (target > RESERVE - GB) {
+        fprintf(stderr, "mmscale: -g must leave 1 GB of the %llu GB reserved\n",
+                (unsigned long long)(RESERVE / GB));
+        exit(1);
+    }
+
+    nblocks = target / (block + 16) + 1;
+    if ((blocks = malloc(nblocks * sizeof(char *))) == NULL) {
+        fprintf(stderr, "mmscale: malloc failed\n");
+        exit(1);
+    }
+
+    mem_init_reserve(RESERVE);
+    check(mm_init() == 0, "mm_init failed");
+
+    /*
+     * Phase 1: grow the brk heap past 2 GB, 4 GB, ... with sub-threshold
+     * blocks. Time per allocation between two marks must stay flat as
+     * the heap grows.
+     */
+    printf("%10s %12s %10s\n", "heap", "blocks", "ns/alloc");
+    start = mark_start = now();
+    next_mark = 1 * GB;
+    mark_blocks = 0;
+    for (i = 0; i < nblocks && mem_heapsize() < target; i++) {
+        blocks[i] = mm_malloc(block);
+        check(blocks[i] != NULL, "mm_malloc failed while growing the heap");
+        blocks[i][0] = blocks[i][block - 1] = (char)i;
+
+        if (mem_heapsize() >= next_mark) {
+            double t = now();
+            printf("%8zuGB %12zu %10.1f\n", next_mark / GB, i + 1,
+                   (t - mark_start) * 1e9 / (i + 1 - mark_blocks));
+            next_mark *= 2;
+            mark_start = t;
+            mark_blocks = i + 1;
+        }
+    }
+    nblocks = i;
+    printf("grew heap to %.2f GB in %.2f s, peak RSS %ld MB\n",
+           (double)mem_heapsize() / GB, now() - start, peak_rss_kb() / 1024);
+
+    /* Every boundary tag of the multi-GB heap must still be consistent */
+    mm_checkheap(0);
+    for (i = 0; i < nblocks; i++)
+        check(blocks[i][0] == (char)i && blocks[i][block - 1] == (char)i,
+              "heap block lost its contents");
+
+    /*
+     * Phase 2: single blocks over 2 GB and 4 GB go to their own
+     * mappings and grow through mremap without copying.
+     */
+    {
+        size_t huge = 3 * GB;
+        char *p = mm_malloc(huge);
+
+        check(p != NULL, "mm_malloc of a 3 GB block failed");
+        p[0] = 'a';
+        p[huge - 1] = 'z';
+
+        start = now();
+        p = mm_realloc(p, 3 * huge);
+        check(p[0] == 'a' && p[huge - 1] == 'z', "mm_realloc lost the 3 GB block");
+        p[3 * huge - 1] = '!';
+        printf("realloc 3 GB -> 9 GB in %.1f us\n", (now() - start) * 1e6);
+        mm_free(p);
+    }
+
+    /*
+     * Phase 3: freeing every block coalesces them into one free block
+     * far beyond 32 bits, which mm_trim hands back in one piece.
+     */
+    start = now();
+    for (i = 0; i < nblocks; i++)
+        mm_free(blocks[i]);
+    printf("freed %zu blocks in %.2f s\n", nblocks, now() - start);
+
+    mm_checkheap(0);
+    mm_trim(0);
+    printf("heap after mm_trim: %zu bytes, mapped: %zu bytes\n",
+           mem_heapsize(), mem_mapsize());
+    check(mem_heapsize() < GB, "mm_trim did not shrink the heap");
+
+    free(blocks);
+    mem_deinit();
+    return 0;
+}
+
+/*
+ * now - wall clock time in seconds
+ */
+static double now(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+/*
+ * peak_rss_kb - peak resident set size of this process in KB
+ */
+static long peak_rss_kb(void) {
+    char line[256];
+    long kb = -1;
+    FILE *status = fopen("/proc/self/status", "r");
+
+    if (status == NULL)
+        return -1;
+    while (fgets(line, sizeof(line), status) != NULL)
+        if (sscanf(line, "VmHWM: %ld kB", &kb) == 1)
+            break;
+    fclose(status);
+    return kb;
+}
+
+/*
+ * check - abort the benchmark with msg unless ok
+ */
+static void check(int ok, char *msg) {
+    if (!ok) {
+        printf("mmscale: %s\n", msg);
+        exit(1);
+    }
+}
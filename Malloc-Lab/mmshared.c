@@ -0,0 +1,235 @@
+/*
+ * mmshared.c - Ping-pong benchmark for heaps shared between processes
+ *
+ * A parent and a child exchange messages of a fixed size. In the pipe
+ * round every message is written through a pipe in full, as serialized
+ * data would be. In the shared round both processes open the same shared
+ * heap with mm_shared_open: the sender mm_heap_mallocs and fills the
+ * message, writes only its offset to the pipe, and the receiver reads the
+ * payload in place and mm_heap_frees it. Both rounds touch every byte of
+ * every message on both sides, so the difference is the copying.
+ *
+ * usage: mmshared [-n <round trips>] [-s <message bytes>]
+ */
+#include "config.h"
+#include "memlib.h"
+#include "mm.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define HEAP_NAME "/mmshared-bench"
+#define HEAP_SIZE ((size_t)1 << 30)
+
+static void pipe_peer(int in, int out, size_t size, long n, int first);
+static void shared_peer(int in, int out, size_t size, long n, int first);
+static void fill(char *msg, size_t size, long i);
+static void check_msg(char *msg, size_t size, long i);
+static void read_full(int fd, void *buf, size_t size);
+static void write_full(int fd, void *buf, size_t size);
+static double run(void (*peer)(int, int, size_t, long, int), size_t size,
+                  long n);
+static double now(void);
+
+int main(int argc, char **argv) {
+    long n = 20000;           /* round trips per round (-n) */
+    size_t size = 64 * 1024;  /* bytes per message (-s) */
+    double pipe_secs, shared_secs;
+    char c;
+
+    while ((c = getopt(argc, argv, "n:s:h")) != EOF) {
+        switch (c) {
+        case 'n':
+            n = strtol(optarg, NULL, 0);
+            break;
+        case 's':
+            size = strtoull(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: mmshared [-n <round trips>] [-s <message bytes>]\n");
+            exit(c == 'h' ? 0 : 1);
+        }
+    }
+    if (size < sizeof(long) || size > HEAP_SIZE / 64) {
+        fprintf(stderr, "mmshared: -s must be between %zu and %zu\n",
+                sizeof(long), HEAP_SIZE / 64);
+        exit(1);
+    }
+
+    pipe_secs = run(pipe_peer, size, n);
+    shared_secs = run(shared_peer, size, n);
+
+    printf("%10s %12s %12s %12s\n", "round", "round trips", "us/trip", "MB/s");
+    printf("%10s %12ld %12.2f %12.1f\n", "pipe", n, pipe_secs * 1e6 / n,
+           2.0 * n * size / pipe_secs / (1 << 20));
+    printf("%10s %12ld %12.2f %12.1f\n", "shared", n, shared_secs * 1e6 / n,
+           2.0 * n * size / shared_secs / (1 << 20));
+    return 0;
+}
+
+/*
+ * run - fork a child, play n round trips of size byte messages between it
+ *    and the parent with peer, and return the elapsed seconds
+ */
+static double run(void (*peer)(int, int, size_t, long, int), size_t size,
+                  long n) {
+    int down[2], up[2], status;
+    double start;
+    pid_t pid;
+
+    shm_unlink(HEAP_NAME);
+    if (pipe(down) < 0 || pipe(up) < 0) {
+        perror("mmshared: pipe");
+        exit(1);
+    }
+
+    start = now();
+    if ((pid = fork()) == 0) {
+        close(down[1]);
+        close(up[0]);
+        peer(down[0], up[1], size, n, 0);
+        exit(0);
+    }
+    close(down[0]);
+    close(up[1]);
+    peer(up[0], down[1], size, n, 1);
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "mmshared: child failed\n");
+        exit(1);
+    }
+    close(up[0]);
+    close(down[1]);
+    shm_unlink(HEAP_NAME);
+    return now() - start;
+}
+
+/*
+ * pipe_peer - one side of the pipe round: the whole message goes through
+ *    the pipe each way
+ */
+static void pipe_peer(int in, int out, size_t size, long n, int first) {
+    char *msg = malloc(size);
+    long i;
+
+    for (i = 0; i < n; i++) {
+        if (first) {
+            fill(msg, size, i);
+            write_full(out, msg, size);
+            read_full(in, msg, size);
+            check_msg(msg, size, i);
+        } else {
+            read_full(in, msg, size);
+            check_msg(msg, size, i);
+            fill(msg, size, i);
+            write_full(out, msg, size);
+        }
+    }
+    free(msg);
+}
+
+/*
+ * shared_peer - one side of the shared round: messages are blocks of the
+ *    shared heap and only their offsets go through the pipe
+ */
+static void shared_peer(int in, int out, size_t size, long n, int first) {
+    mm_heap_t *heap = mm_shared_open(HEAP_NAME, HEAP_SIZE);
+    size_t offset;
+    char *msg;
+    long i;
+
+    if (heap == NULL) {
+        fprintf(stderr, "mmshared: mm_shared_open failed\n");
+        exit(1);
+    }
+
+    for (i = 0; i < n; i++) {
+        if (first) {
+            msg = mm_heap_malloc(heap, size);
+            fill(msg, size, i);
+            offset = mm_shared_offset(heap, msg);
+            write_full(out, &offset, sizeof(offset));
+        }
+        read_full(in, &offset, sizeof(offset));
+        msg = mm_shared_pointer(heap, offset);
+        check_msg(msg, size, i);
+        mm_heap_free(heap, msg);
+        if (!first) {
+            msg = mm_heap_malloc(heap, size);
+            fill(msg, size, i);
+            offset = mm_shared_offset(heap, msg);
+            write_full(out, &offset, sizeof(offset));
+        }
+    }
+    mm_shared_close(heap);
+}
+
+/*
+ * fill - write message i
+ */
+static void fill(char *msg, size_t size, long i) {
+    memset(msg, (char)i, size);
+    *(long *)msg = i;
+}
+
+/*
+ * check_msg - read every byte of message i and make sure it is intact
+ */
+static void check_msg(char *msg, size_t size, long i) {
+    size_t j;
+    long sum = 0;
+
+    for (j = sizeof(long); j < size; j++)
+        sum += msg[j] != (char)i;
+    if (*(long *)msg != i || sum != 0) {
+        fprintf(stderr, "mmshared: message %ld corrupted\n", i);
+        exit(1);
+    }
+}
+
+/*
+ * read_full - read exactly size bytes from fd
+ */
+static void read_full(int fd, void *buf, size_t size) {
+    ssize_t got;
+
+    while (size > 0) {
+        if ((got = read(fd, buf, size)) <= 0) {
+            perror("mmshared: read");
+            exit(1);
+        }
+        buf = (char *)buf + got;
+        size -= got;
+    }
+}
+
+/*
+ * write_full - write exactly size bytes to fd
+ */
+static void write_full(int fd, void *buf, size_t size) {
+    ssize_t put;
+
+    while (size > 0) {
+        if ((put = write(fd, buf, size)) <= 0) {
+            perror("mmshared: write");
+            exit(1);
+        }
+        buf = (char *)buf + put;
+        size -= put;
+    }
+}
+
+/*
+ * now - wall clock time in seconds
+ */
+static double now(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}